@@ -0,0 +1,48 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+
+// Size of the first block, enough for the coefficients of a small image.
+constexpr size_t MIN_BLOCK_SIZE = 64 * 1024;
+
+}
+
+void *Arena::allocate(size_t size, size_t alignment) {
+    if (!blocks.empty()) {
+        Block &block = blocks.back();
+        auto address = (std::uintptr_t) block.data.get() + offset;
+        size_t padding = (alignment - address % alignment) % alignment;
+        if (padding + size <= block.size - offset) {
+            offset += padding + size;
+            used_bytes += padding + size;
+            return block.data.get() + offset - size;
+        }
+    }
+
+    // Grows geometrically, so that an image needs a few blocks at most before they are merged.
+    size_t block_size = std::max({size + alignment, MIN_BLOCK_SIZE, blocks.empty() ? 0 : blocks.back().size * 2});
+    blocks.push_back(Block {std::make_unique_for_overwrite<unsigned char[]>(block_size), block_size});
+    offset = 0;
+    return allocate(size, alignment);
+}
+
+void Arena::reset() {
+    if (blocks.size() > 1) {
+        size_t total = capacity();
+        blocks.clear();
+        blocks.push_back(Block {std::make_unique_for_overwrite<unsigned char[]>(total), total});
+    }
+    offset = 0;
+    used_bytes = 0;
+}
+
+size_t Arena::capacity() const {
+    size_t total = 0;
+    for (const Block &block: blocks) {
+        total += block.size;
+    }
+    return total;
+}
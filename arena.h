@@ -0,0 +1,52 @@
+#ifndef UNTITLED_ARENA_H
+#define UNTITLED_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for the storage of one image at a time. Allocations are not freed one by one: reset() frees
+// them all at once, keeping the memory for the next image. When an image needs more than the first block, the
+// blocks are merged at reset() into a single one of their total size, so once the largest image has been
+// decoded, decoding takes everything from that block without going through malloc.
+// Not thread safe, each decoding context has its own (see JPEGEncoded::arena).
+class Arena {
+public:
+    Arena() noexcept = default;
+    Arena(Arena &&) noexcept = default;
+    Arena &operator=(Arena &&) noexcept = default;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    // `alignment` must be a power of 2.
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+    // Storage for `count` objects, left uninitialized.
+    template <class T>
+    std::span<T> allocate_array(size_t count, size_t alignment = alignof(T)) {
+        static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>);
+        return {static_cast<T *>(allocate(count * sizeof(T), alignment)), count};
+    }
+
+    // Invalidates everything allocated so far.
+    void reset();
+
+    // Bytes allocated since the last reset(), alignment padding included.
+    size_t used() const { return used_bytes; }
+    // Bytes held, whether allocated or not.
+    size_t capacity() const;
+
+private:
+    struct Block {
+        std::unique_ptr<unsigned char[]> data;
+        size_t size;
+    };
+    // The last one is the one allocations are taken from.
+    std::vector<Block> blocks;
+    // Offset of the free space in the last block.
+    size_t offset = 0;
+    size_t used_bytes = 0;
+};
+
+#endif //UNTITLED_ARENA_H
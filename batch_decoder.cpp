@@ -0,0 +1,137 @@
+#include "batch_decoder.h"
+
+BatchDecoder::BatchDecoder(PixelFormat format, Upsampling upsampling, Scale scale, ThreadPool &pool):
+format(format), upsampling(upsampling), scale(scale), pool(pool), pending(0) {}
+
+BatchDecoder::~BatchDecoder() {
+    std::unique_lock<std::mutex> lock {mutex};
+    pending_done.wait(lock, [this] { return pending == 0; });
+}
+
+Decoder &BatchDecoder::acquire() {
+    std::lock_guard<std::mutex> lock {mutex};
+    if (idle_contexts.empty()) {
+        contexts.push_back(std::make_unique<Decoder>(format, upsampling, scale));
+        // Restart intervals are decoded on the same pool, by the threads not busy with other images.
+        contexts.back()->set_thread_pool(&pool);
+        return *contexts.back();
+    }
+    Decoder *decoder = idle_contexts.back();
+    idle_contexts.pop_back();
+    return *decoder;
+}
+
+void BatchDecoder::release(Decoder &decoder) {
+    std::lock_guard<std::mutex> lock {mutex};
+    idle_contexts.push_back(&decoder);
+}
+
+void BatchDecoder::decode(std::span<const std::span<const unsigned char>> inputs, const ImageCallback &on_image,
+                          const ErrorCallback &on_error) {
+    pool.parallel_for(inputs.size(), [&](size_t i) {
+        Decoder &decoder = acquire();
+        try {
+            on_image(i, decoder.decode(inputs[i]));
+        } catch (...) {
+            release(decoder);
+            if (!on_error) {
+                throw;
+            }
+            on_error(i, std::current_exception());
+            return;
+        }
+        release(decoder);
+    });
+}
+
+std::vector<std::future<Image>> BatchDecoder::decode_async(std::span<const std::span<const unsigned char>> inputs) {
+    // Shared by the iterations, and freed along with the loop once the last one is done.
+    auto batch = std::make_shared<std::vector<std::span<const unsigned char>>>(inputs.begin(), inputs.end());
+    auto promises = std::make_shared<std::vector<std::promise<Image>>>(inputs.size());
+    std::vector<std::future<Image>> futures;
+    for (std::promise<Image> &promise: *promises) {
+        futures.push_back(promise.get_future());
+    }
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+        pending += inputs.size();
+    }
+
+    pool.run_async(inputs.size(), [this, batch, promises](size_t i) {
+        Decoder &decoder = acquire();
+        try {
+            decoder.decode((*batch)[i]);
+            (*promises)[i].set_value(decoder.take_image());
+        } catch (...) {
+            (*promises)[i].set_exception(std::current_exception());
+        }
+        release(decoder);
+
+        // Notified with the lock held, since the destructor may run as soon as `pending` is 0.
+        std::lock_guard<std::mutex> lock {mutex};
+        pending -= 1;
+        pending_done.notify_all();
+    });
+    return futures;
+}
+
+void BatchDecoder::decode_files(std::span<const std::string> paths, FileLoader &loader, const ImageCallback &on_image,
+                                const ErrorCallback &on_error) {
+    std::mutex files_mutex;
+    std::condition_variable decoded;
+    // Files read but not decoded yet.
+    size_t outstanding = 0;
+    const size_t max_outstanding = 2 * (size_t) pool.size();
+    std::exception_ptr first_error;
+
+    auto report = [&](size_t index, std::exception_ptr error) {
+        if (on_error) {
+            on_error(index, error);
+            return;
+        }
+        std::lock_guard<std::mutex> lock {files_mutex};
+        if (!first_error) {
+            first_error = error;
+        }
+    };
+    auto wait_outstanding = [&](size_t count) {
+        std::unique_lock<std::mutex> lock {files_mutex};
+        decoded.wait(lock, [&] { return outstanding <= count; });
+    };
+
+    try {
+        loader.load(paths, [&](LoadedFile &file) {
+            if (file.error) {
+                report(file.index, file.error);
+                return;
+            }
+            wait_outstanding(max_outstanding - 1);
+            {
+                std::lock_guard<std::mutex> lock {files_mutex};
+                outstanding += 1;
+            }
+            auto loaded = std::make_shared<LoadedFile>(std::move(file));
+            pool.run_async(1, [&, loaded](size_t) {
+                Decoder &decoder = acquire();
+                try {
+                    on_image(loaded->index, decoder.decode(loaded->data));
+                    release(decoder);
+                } catch (...) {
+                    release(decoder);
+                    report(loaded->index, std::current_exception());
+                }
+                // Notified with the lock held, since the locals of decode_files() go as soon as it is 0.
+                std::lock_guard<std::mutex> lock {files_mutex};
+                outstanding -= 1;
+                decoded.notify_all();
+            });
+        });
+    } catch (...) {
+        wait_outstanding(0);
+        throw;
+    }
+    wait_outstanding(0);
+    if (first_error) {
+        std::rethrow_exception(first_error);
+    }
+}
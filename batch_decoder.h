@@ -0,0 +1,68 @@
+#ifndef UNTITLED_BATCH_DECODER_H
+#define UNTITLED_BATCH_DECODER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include "decoder.h"
+#include "file_loader.h"
+#include "thread_pool.h"
+
+// Decodes many files concurrently on a thread pool. Each image is decoded by a single thread, with a Decoder
+// context taken from a set kept by the BatchDecoder, so buffers are reused from one image to the next and
+// there are never more contexts than images decoded at the same time.
+//
+//     BatchDecoder batch;
+//     batch.decode(files, [](size_t i, const Image &image) { ... });
+class BatchDecoder {
+public:
+    explicit BatchDecoder(PixelFormat format = PixelFormat::RGB, Upsampling upsampling = Upsampling::Fancy,
+                          Scale scale = Scale::Full, ThreadPool &pool = ThreadPool::shared());
+    // Waits for the images of decode_async() still being decoded.
+    ~BatchDecoder();
+    BatchDecoder(const BatchDecoder &) = delete;
+    BatchDecoder &operator=(const BatchDecoder &) = delete;
+
+    // Called from any thread of the pool, possibly concurrently, with the index of the input in the batch.
+    // The image is only valid during the call, as its buffers are reused for the next inputs.
+    using ImageCallback = std::function<void(size_t index, const Image &image)>;
+    using ErrorCallback = std::function<void(size_t index, std::exception_ptr error)>;
+
+    // Decodes every input, and returns once they are all done. Without `on_error`, the first error is rethrown
+    // at the end (the other inputs are still decoded).
+    void decode(std::span<const std::span<const unsigned char>> inputs, const ImageCallback &on_image,
+                const ErrorCallback &on_error = {});
+    // Starts decoding every input and returns immediately. The inputs themselves (but not the span of them) must
+    // stay valid until the futures are ready.
+    std::vector<std::future<Image>> decode_async(std::span<const std::span<const unsigned char>> inputs);
+    // Reads the files with `loader` while decoding the ones already read, and returns once they are all done.
+    // The index is that of the path, errors reading a file are reported like decoding ones. Reading is paused
+    // while twice as many files as threads in the pool are waiting to be decoded, to bound the memory used.
+    void decode_files(std::span<const std::string> paths, FileLoader &loader, const ImageCallback &on_image,
+                      const ErrorCallback &on_error = {});
+
+private:
+    PixelFormat format;
+    Upsampling upsampling;
+    Scale scale;
+    ThreadPool &pool;
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Decoder>> contexts;
+    std::vector<Decoder *> idle_contexts;
+    // Images of decode_async() not decoded yet.
+    size_t pending;
+    std::condition_variable pending_done;
+
+    Decoder &acquire();
+    void release(Decoder &decoder);
+};
+
+#endif //UNTITLED_BATCH_DECODER_H
@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "decoder.h"
+#include "jpeg_parser.h"
+#include "mapped_file.h"
+
+// Decodes every file of a corpus a few times, timing each stage on its own as well as the whole decoding, so
+// that a regression can be traced to the stage causing it.
+//
+//     jpeg_bench [-n iterations] [-p] <files or directories>
+//
+// With -p, the whole decoding is pipelined (see Decoder::set_pipelined()).
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Seconds spent in each stage for one decoding of an image.
+struct Timings {
+    // Marker segments up to the first scan.
+    double markers;
+    // Everything else JPEGParser::parse() does, i.e. mostly Huffman decoding.
+    double entropy;
+    double idct;
+    // Upsampling included.
+    double color;
+    // Decoder::decode(), which does all of the above.
+    double decode;
+};
+
+Timings measure(std::span<const unsigned char> data, Decoder &decoder) {
+    Timings timings {};
+    Clock::time_point start = Clock::now();
+    {
+        JPEGParser parser {data};
+        JPEGEncoded encoded {};
+        ScanHeader scan {};
+        parser.parse_until_scan(encoded, scan);
+    }
+    timings.markers = seconds_since(start);
+
+    JPEGParser parser {data};
+    JPEGEncoded encoded {};
+    start = Clock::now();
+    parser.parse(encoded);
+    timings.entropy = std::max(seconds_since(start) - timings.markers, 0.0);
+
+    // Rendered like decode_image() does, timing the two steps of each MCU row.
+    MCURowRenderer renderer {encoded.frame, encoded.q_tables, PixelFormat::RGB, Upsampling::Fancy};
+    size_t row_size = (size_t) renderer.width() * bytes_per_pixel(PixelFormat::RGB);
+    std::vector<unsigned char> pixels(row_size * renderer.height());
+    int mcus_y = encoded.frame.mcus_y();
+    for (int mcu_row = 0; mcu_row <= mcus_y; mcu_row++) {
+        if (mcu_row < mcus_y) {
+            start = Clock::now();
+            renderer.transform(encoded.coefficients, mcu_row);
+            timings.idct += seconds_since(start);
+        }
+        if (mcu_row > 0) {
+            start = Clock::now();
+            renderer.convert(mcu_row - 1, pixels.data(), row_size);
+            timings.color += seconds_since(start);
+        }
+    }
+
+    start = Clock::now();
+    decoder.decode(data);
+    timings.decode = seconds_since(start);
+    return timings;
+}
+
+void add_inputs(const std::filesystem::path &path, std::vector<std::filesystem::path> &inputs) {
+    if (!std::filesystem::is_directory(path)) {
+        inputs.push_back(path);
+        return;
+    }
+    for (const auto &entry: std::filesystem::recursive_directory_iterator(path)) {
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char) std::tolower(c); });
+        if (entry.is_regular_file() && (extension == ".jpg" || extension == ".jpeg" || extension == ".jfif")) {
+            inputs.push_back(entry.path());
+        }
+    }
+    std::sort(inputs.begin(), inputs.end());
+}
+
+double percentile(std::vector<double> &values, double fraction) {
+    size_t index = std::min(values.size() - 1, (size_t) (fraction * (double) values.size()));
+    std::nth_element(values.begin(), values.begin() + (long) index, values.end());
+    return values[index];
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 5;
+    bool pipelined = false;
+    std::vector<std::filesystem::path> inputs;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "-p") == 0) {
+            pipelined = true;
+        } else {
+            add_inputs(argv[i], inputs);
+        }
+    }
+    if (inputs.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [-n iterations] [-p] <files or directories>" << std::endl;
+        return 2;
+    }
+
+    Decoder decoder;
+    decoder.set_pipelined(pipelined);
+    Timings total {};
+    double bytes = 0;
+    double pixels = 0;
+    int images = 0;
+    // Of every decoding of every image, in milliseconds.
+    std::vector<double> latencies;
+
+    for (const std::filesystem::path &input: inputs) {
+        try {
+            MappedFile file = MappedFile::open(input.string().c_str());
+            // Warms up the caches and the decoder buffers.
+            measure(file.data(), decoder);
+            for (int i = 0; i < iterations; i++) {
+                Timings timings = measure(file.data(), decoder);
+                total.markers += timings.markers;
+                total.entropy += timings.entropy;
+                total.idct += timings.idct;
+                total.color += timings.color;
+                total.decode += timings.decode;
+                latencies.push_back(timings.decode * 1000);
+            }
+            bytes += (double) file.data().size() * iterations;
+            pixels += (double) decoder.encoded().frame.width * decoder.encoded().frame.height * iterations;
+            images += 1;
+        } catch (const std::exception &error) {
+            std::cerr << "Skipped " << input.string() << ": " << error.what() << std::endl;
+        }
+    }
+    if (images == 0) {
+        std::cerr << "No image could be decoded" << std::endl;
+        return 1;
+    }
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << images << " images, " << bytes / iterations / 1e6 << " MB, " << pixels / iterations / 1e6
+              << " MP, " << iterations << " iterations" << std::endl;
+    std::cout << std::left << std::setw(10) << "stage" << std::right << std::setw(12) << "MB/s" << std::setw(12)
+              << "MP/s" << std::endl;
+    auto report = [&](const char *stage, double seconds) {
+        std::cout << std::left << std::setw(10) << stage << std::right << std::setw(12) << bytes / seconds / 1e6
+                  << std::setw(12) << pixels / seconds / 1e6 << std::endl;
+    };
+    report("markers", total.markers);
+    report("entropy", total.entropy);
+    report("idct", total.idct);
+    report("color", total.color);
+    report("decode", total.decode);
+
+    std::cout << std::setprecision(3) << "latency (ms): p50 " << percentile(latencies, 0.5) << ", p90 "
+              << percentile(latencies, 0.9) << ", p99 " << percentile(latencies, 0.99) << ", max "
+              << *std::max_element(latencies.begin(), latencies.end()) << std::endl;
+    return 0;
+}
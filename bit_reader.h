@@ -0,0 +1,180 @@
+#ifndef UNTITLED_BIT_READER_H
+#define UNTITLED_BIT_READER_H
+
+#include <bit>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#include "decode_stats.h"
+
+// Reads the entropy-coded data of a scan MSB first, removing the 0xFF00 byte stuffing on the fly.
+// Bits are kept left-aligned in a 64-bit buffer. A refill loads 8 bytes at once and only takes the byte-wise
+// path when one of them is 0xFF, so there is one branch per refill instead of one per byte.
+// Once a marker (or the end of the data) is reached, the reader keeps returning zero bits.
+// The reader only depends on a pointer and a size, so it can be benchmarked on its own.
+class BitReader {
+public:
+    BitReader(const unsigned char *data, size_t size) noexcept:
+    data(data), size(size), pos(0), buffer(0), bits(0), marker_reached(false), end_reached(false),
+    refill_count(0) {};
+
+    // Makes sure at least `count` (at most 57) bits are buffered.
+    void ensure(int count) {
+        if (bits < count) {
+            refill();
+        }
+    }
+
+    // Returns the next `count` (1 to 32) bits without consuming them. Needs a prior ensure(count).
+    unsigned int peek(int count) const {
+        return (unsigned int) (buffer >> (64 - count));
+    }
+
+    void skip(int count) {
+        buffer <<= count;
+        bits -= count;
+    }
+
+    // Reads `count` (1 to 16) magnitude bits and sign-extends them. Needs a prior ensure(count).
+    int receive_extend(int count) {
+        unsigned int value = peek(count);
+        skip(count);
+        return value < (1u << (count - 1)) ? (int) value - (1 << count) + 1 : (int) value;
+    }
+
+    // Number of input bytes fetched into the bit buffer so far. Bits still buffered are not accounted for.
+    size_t position() const { return pos; }
+
+    // Number of refills of the bit buffer, only counted when collecting stats (see decode_stats.h).
+    unsigned long long refills() const { return refill_count; }
+
+    bool reached_marker() const { return marker_reached; }
+    // Whether zero bits were made up because the data ended without a marker, i.e. it is truncated or, when
+    // streaming, not fully received yet.
+    bool reached_end() const { return end_reached; }
+
+    // Moves past the next marker, which ends a restart interval, and starts over with an empty bit buffer.
+    // Returns the marker (0xD0 to 0xD7 for RSTn). Any other marker is not consumed and 0 is returned, as well
+    // as when the data ends before a marker. Decoding then goes on with zero bits.
+    unsigned char restart() {
+        buffer = 0;
+        bits = 0;
+        size_t i = pos;
+        // Skips the leftover bits of the last byte (and whatever garbage) up to the marker, and its fill bytes.
+        while (i + 1 < size && (data[i] != 0xff || data[i + 1] == 0x00 || data[i + 1] == 0xff)) {
+            i += 1;
+        }
+        if (i + 1 >= size) {
+            pos = size;
+            end_reached = true;
+            return 0;
+        }
+        unsigned char marker = data[i + 1];
+        if (marker < 0xd0 || marker > 0xd7) {
+            pos = i;
+            marker_reached = true;
+            return 0;
+        }
+        pos = i + 2;
+        marker_reached = false;
+        return marker;
+    }
+
+    // Everything the reader knows, enough to resume reading later on from the same point of the same data.
+    struct State {
+        size_t pos;
+        unsigned long long buffer;
+        int bits;
+        bool marker_reached;
+        bool end_reached;
+    };
+    State state() const { return State {pos, buffer, bits, marker_reached, end_reached}; }
+    // `state` must come from state() on the same data, or have an empty buffer and pos at most the size.
+    void restore(const State &state) {
+        pos = state.pos;
+        buffer = state.buffer;
+        bits = state.bits;
+        marker_reached = state.marker_reached;
+        end_reached = state.end_reached;
+    }
+
+    // Points the reader to a new copy of the same data, possibly longer. The read position is kept.
+    void rebase(const unsigned char *new_data, size_t new_size) noexcept {
+        data = new_data;
+        size = new_size;
+    }
+
+private:
+    const unsigned char *data;
+    size_t size;
+    size_t pos;
+    unsigned long long buffer;
+    int bits;
+    bool marker_reached;
+    bool end_reached;
+    unsigned long long refill_count;
+
+    void refill() {
+        if constexpr (collect_stats) {
+            refill_count += 1;
+        }
+        if (pos + 8 <= size) {
+            unsigned long long word = load_be64(data + pos);
+            if (!has_ff_byte(word)) {
+                // Some bits below the 56 we account for get read twice, which is harmless since they are ORed
+                // with the very same data by the next refill.
+                buffer |= word >> bits;
+                pos += (63 - bits) >> 3;
+                bits |= 56;
+                return;
+            }
+        }
+        refill_slow();
+    }
+
+    void refill_slow() {
+        // Clear the bits a previous fast refill left past the accounted ones, this path does not rewrite them.
+        buffer = bits == 0 ? 0 : buffer & (~0ULL << (64 - bits));
+        while (bits <= 56) {
+            unsigned long long byte = 0;
+            if (marker_reached) {
+                // Keep reading zeros
+            } else if (pos >= size || (data[pos] == 0xff && pos + 1 >= size)) {
+                end_reached = true;
+            } else {
+                byte = data[pos];
+                if (byte != 0xff) {
+                    pos += 1;
+                } else if (data[pos + 1] == 0x00) {
+                    pos += 2;
+                } else {
+                    marker_reached = true;
+                    byte = 0;
+                }
+            }
+            buffer |= byte << (56 - bits);
+            bits += 8;
+        }
+    }
+
+    static unsigned long long load_be64(const unsigned char *p) {
+        unsigned long long word;
+        std::memcpy(&word, p, 8);
+        if constexpr (std::endian::native == std::endian::big) {
+            return word;
+        }
+#if defined(_MSC_VER)
+        return _byteswap_uint64(word);
+#else
+        return __builtin_bswap64(word);
+#endif
+    }
+
+    static bool has_ff_byte(unsigned long long word) {
+        // Classic "has a zero byte" test, applied to the complement.
+        return ((~word - 0x0101010101010101ULL) & word & 0x8080808080808080ULL) != 0;
+    }
+};
+
+#endif //UNTITLED_BIT_READER_H
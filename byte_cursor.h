@@ -0,0 +1,60 @@
+#ifndef UNTITLED_BYTE_CURSOR_H
+#define UNTITLED_BYTE_CURSOR_H
+
+#include <cstddef>
+#include <span>
+#include <utility>
+
+#include "jpeg_error.h"
+
+// Reads the fields of a marker segment, big-endian. The bytes are checked once per structure with require(),
+// e.g. for a whole frame header, rather than at each read, so a malformed segment throws a JPEGError before
+// anything is read out of it, without a branch per byte.
+class ByteCursor {
+public:
+    // `offset` is the position of `data` in the file, for the errors.
+    ByteCursor(std::span<const unsigned char> data, size_t offset) noexcept: data(data), base(offset), pos(0) {}
+
+    // Makes sure `count` more bytes can be read.
+    void require(size_t count) const {
+        if (count > data.size() - pos) {
+            throw JPEGError("Truncated segment", offset());
+        }
+    }
+
+    // Reads of bytes covered by a prior require().
+    unsigned char u8() { return data[pos++]; }
+    unsigned short u16() {
+        unsigned short value = (unsigned short) ((data[pos] << 8) | data[pos + 1]);
+        pos += 2;
+        return value;
+    }
+    // Splits the high and low 4 bits of a byte.
+    std::pair<unsigned char, unsigned char> u4_pair() {
+        unsigned char value = u8();
+        return {(unsigned char) (value >> 4), (unsigned char) (value & 0x0f)};
+    }
+
+    // Checked on their own.
+    std::span<const unsigned char> bytes(size_t count) {
+        require(count);
+        std::span<const unsigned char> taken = data.subspan(pos, count);
+        pos += count;
+        return taken;
+    }
+    void skip(size_t count) {
+        require(count);
+        pos += count;
+    }
+
+    size_t remaining() const { return data.size() - pos; }
+    // Position in the file of the next byte.
+    size_t offset() const { return base + pos; }
+
+private:
+    std::span<const unsigned char> data;
+    size_t base;
+    size_t pos;
+};
+
+#endif //UNTITLED_BYTE_CURSOR_H
@@ -0,0 +1,491 @@
+#include "color.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define COLOR_SSE2
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define COLOR_NEON
+#endif
+
+// YCbCr to RGB coefficients, scaled by 2^COLOR_SHIFT. Every implementation computes exactly
+// y + ((coefficient * chroma + COLOR_ROUNDING) >> COLOR_SHIFT) so they all give the same pixels.
+constexpr int COLOR_SHIFT = 14;
+constexpr int COLOR_ROUNDING = 1 << (COLOR_SHIFT - 1);
+constexpr int CR_TO_R = 22970;   // 1.402
+constexpr int CB_TO_G = -5638;   // -0.344136
+constexpr int CR_TO_G = -11700;  // -0.714136
+constexpr int CB_TO_B = 29032;   // 1.772
+
+int bytes_per_pixel(PixelFormat format) {
+    return format == PixelFormat::RGBA ? 4 : 3;
+}
+
+static unsigned char clamp_sample(int value) {
+    return (unsigned char) std::clamp(value, 0, 255);
+}
+
+static void store_pixel(unsigned char *output, unsigned char r, unsigned char g, unsigned char b, PixelFormat format) {
+    switch (format) {
+        case PixelFormat::RGB:
+            output[0] = r; output[1] = g; output[2] = b;
+            break;
+        case PixelFormat::RGBA:
+            output[0] = r; output[1] = g; output[2] = b; output[3] = 0xff;
+            break;
+        case PixelFormat::BGR:
+            output[0] = b; output[1] = g; output[2] = r;
+            break;
+    }
+}
+
+static void ycc_to_rgb_scalar(const unsigned char *y, const unsigned char *cb, const unsigned char *cr,
+                              unsigned char *output, int from, int width, PixelFormat format) {
+    int bpp = bytes_per_pixel(format);
+    for (int x = from; x < width; x++) {
+        int cb_value = cb[x] - 128;
+        int cr_value = cr[x] - 128;
+        int r = y[x] + ((CR_TO_R * cr_value + COLOR_ROUNDING) >> COLOR_SHIFT);
+        int g = y[x] + ((CB_TO_G * cb_value + CR_TO_G * cr_value + COLOR_ROUNDING) >> COLOR_SHIFT);
+        int b = y[x] + ((CB_TO_B * cb_value + COLOR_ROUNDING) >> COLOR_SHIFT);
+        store_pixel(output + x * bpp, clamp_sample(r), clamp_sample(g), clamp_sample(b), format);
+    }
+}
+
+static void planar_to_rgb_scalar(const unsigned char *r, const unsigned char *g, const unsigned char *b,
+                                 unsigned char *output, int from, int width, PixelFormat format) {
+    int bpp = bytes_per_pixel(format);
+    for (int x = from; x < width; x++) {
+        store_pixel(output + x * bpp, r[x], g[x], b[x], format);
+    }
+}
+
+#if defined(COLOR_SSE2)
+
+// Number of pixels of a row that can go through the 16 pixels wide kernels. The 3 bytes per pixel stores
+// write one byte past each pixel, so they must not process the last pixel of the row.
+static int simd_width(int width, PixelFormat format) {
+    int limit = format == PixelFormat::RGBA ? width : width - 1;
+    return std::max(limit, 0) & ~15;
+}
+
+static void store_pixels_sse2(__m128i r, __m128i g, __m128i b, unsigned char *output, PixelFormat format) {
+    if (format == PixelFormat::BGR) {
+        std::swap(r, b);
+    }
+    __m128i alpha = format == PixelFormat::RGBA ? _mm_set1_epi8((char) 0xff) : _mm_setzero_si128();
+    __m128i rg_lo = _mm_unpacklo_epi8(r, g);
+    __m128i rg_hi = _mm_unpackhi_epi8(r, g);
+    __m128i ba_lo = _mm_unpacklo_epi8(b, alpha);
+    __m128i ba_hi = _mm_unpackhi_epi8(b, alpha);
+    __m128i pixels[4] = {
+        _mm_unpacklo_epi16(rg_lo, ba_lo), _mm_unpackhi_epi16(rg_lo, ba_lo),
+        _mm_unpacklo_epi16(rg_hi, ba_hi), _mm_unpackhi_epi16(rg_hi, ba_hi),
+    };
+    if (format == PixelFormat::RGBA) {
+        for (int i = 0; i < 4; i++) {
+            _mm_storeu_si128((__m128i *) (output + 16 * i), pixels[i]);
+        }
+        return;
+    }
+    // Overlapping 4 byte stores, each one overwriting the padding byte of the previous pixel.
+    unsigned char packed[64];
+    std::memcpy(packed, pixels, 64);
+    for (int i = 0; i < 16; i++) {
+        std::memcpy(output + 3 * i, packed + 4 * i, 4);
+    }
+}
+
+// Color transforms 8 pixels, widened to 16 bits.
+static void ycc_to_rgb_8_sse2(__m128i y, __m128i cb, __m128i cr, __m128i &r, __m128i &g, __m128i &b) {
+    const __m128i r_coefficients = _mm_set1_epi32((CR_TO_R & 0xffff));
+    const __m128i g_coefficients = _mm_set1_epi32((CR_TO_G & 0xffff) | (CB_TO_G << 16));
+    const __m128i b_coefficients = _mm_set1_epi32(CB_TO_B << 16);
+    const __m128i rounding = _mm_set1_epi32(COLOR_ROUNDING);
+
+    // (cr, cb) pairs, so that a single multiply-add gives each 32-bit product sum.
+    __m128i pairs_lo = _mm_unpacklo_epi16(cr, cb);
+    __m128i pairs_hi = _mm_unpackhi_epi16(cr, cb);
+    auto transform = [&](__m128i coefficients) {
+        __m128i lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(pairs_lo, coefficients), rounding), COLOR_SHIFT);
+        __m128i hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(pairs_hi, coefficients), rounding), COLOR_SHIFT);
+        return _mm_add_epi16(y, _mm_packs_epi32(lo, hi));
+    };
+    r = transform(r_coefficients);
+    g = transform(g_coefficients);
+    b = transform(b_coefficients);
+}
+
+static void ycc_to_rgb_sse2(const unsigned char *y, const unsigned char *cb, const unsigned char *cr,
+                            unsigned char *output, int width, PixelFormat format) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i offset = _mm_set1_epi16(128);
+    int bpp = bytes_per_pixel(format);
+    int end = simd_width(width, format);
+    for (int x = 0; x < end; x += 16) {
+        __m128i y8 = _mm_loadu_si128((const __m128i *) (y + x));
+        __m128i cb8 = _mm_loadu_si128((const __m128i *) (cb + x));
+        __m128i cr8 = _mm_loadu_si128((const __m128i *) (cr + x));
+
+        __m128i r_lo;
+        __m128i g_lo;
+        __m128i b_lo;
+        __m128i r_hi;
+        __m128i g_hi;
+        __m128i b_hi;
+        ycc_to_rgb_8_sse2(_mm_unpacklo_epi8(y8, zero),
+                          _mm_sub_epi16(_mm_unpacklo_epi8(cb8, zero), offset),
+                          _mm_sub_epi16(_mm_unpacklo_epi8(cr8, zero), offset), r_lo, g_lo, b_lo);
+        ycc_to_rgb_8_sse2(_mm_unpackhi_epi8(y8, zero),
+                          _mm_sub_epi16(_mm_unpackhi_epi8(cb8, zero), offset),
+                          _mm_sub_epi16(_mm_unpackhi_epi8(cr8, zero), offset), r_hi, g_hi, b_hi);
+
+        store_pixels_sse2(_mm_packus_epi16(r_lo, r_hi), _mm_packus_epi16(g_lo, g_hi), _mm_packus_epi16(b_lo, b_hi),
+                          output + x * bpp, format);
+    }
+    ycc_to_rgb_scalar(y, cb, cr, output, end, width, format);
+}
+
+static void planar_to_rgb_sse2(const unsigned char *r, const unsigned char *g, const unsigned char *b,
+                               unsigned char *output, int width, PixelFormat format) {
+    int bpp = bytes_per_pixel(format);
+    int end = simd_width(width, format);
+    for (int x = 0; x < end; x += 16) {
+        store_pixels_sse2(_mm_loadu_si128((const __m128i *) (r + x)), _mm_loadu_si128((const __m128i *) (g + x)),
+                          _mm_loadu_si128((const __m128i *) (b + x)), output + x * bpp, format);
+    }
+    planar_to_rgb_scalar(r, g, b, output, end, width, format);
+}
+
+#elif defined(COLOR_NEON)
+
+static void store_pixels_neon(uint8x16_t r, uint8x16_t g, uint8x16_t b, unsigned char *output, PixelFormat format) {
+    switch (format) {
+        case PixelFormat::RGB:
+            vst3q_u8(output, uint8x16x3_t {{r, g, b}});
+            break;
+        case PixelFormat::RGBA:
+            vst4q_u8(output, uint8x16x4_t {{r, g, b, vdupq_n_u8(0xff)}});
+            break;
+        case PixelFormat::BGR:
+            vst3q_u8(output, uint8x16x3_t {{b, g, r}});
+            break;
+    }
+}
+
+// Color transforms 8 pixels. vrshrn adds the same rounding constant as the scalar code before shifting.
+static void ycc_to_rgb_8_neon(uint8x8_t y, uint8x8_t cb, uint8x8_t cr, uint8x8_t &r, uint8x8_t &g, uint8x8_t &b) {
+    int16x8_t y16 = vreinterpretq_s16_u16(vmovl_u8(y));
+    int16x8_t cb16 = vreinterpretq_s16_u16(vsubl_u8(cb, vdup_n_u8(128)));
+    int16x8_t cr16 = vreinterpretq_s16_u16(vsubl_u8(cr, vdup_n_u8(128)));
+
+    int16x8_t r16 = vcombine_s16(vrshrn_n_s32(vmull_n_s16(vget_low_s16(cr16), CR_TO_R), COLOR_SHIFT),
+                                 vrshrn_n_s32(vmull_n_s16(vget_high_s16(cr16), CR_TO_R), COLOR_SHIFT));
+    int16x8_t g16 = vcombine_s16(
+            vrshrn_n_s32(vmlal_n_s16(vmull_n_s16(vget_low_s16(cb16), CB_TO_G), vget_low_s16(cr16), CR_TO_G), COLOR_SHIFT),
+            vrshrn_n_s32(vmlal_n_s16(vmull_n_s16(vget_high_s16(cb16), CB_TO_G), vget_high_s16(cr16), CR_TO_G), COLOR_SHIFT));
+    int16x8_t b16 = vcombine_s16(vrshrn_n_s32(vmull_n_s16(vget_low_s16(cb16), CB_TO_B), COLOR_SHIFT),
+                                 vrshrn_n_s32(vmull_n_s16(vget_high_s16(cb16), CB_TO_B), COLOR_SHIFT));
+
+    r = vqmovun_s16(vaddq_s16(y16, r16));
+    g = vqmovun_s16(vaddq_s16(y16, g16));
+    b = vqmovun_s16(vaddq_s16(y16, b16));
+}
+
+static void ycc_to_rgb_neon(const unsigned char *y, const unsigned char *cb, const unsigned char *cr,
+                            unsigned char *output, int width, PixelFormat format) {
+    int bpp = bytes_per_pixel(format);
+    int end = width & ~15;
+    for (int x = 0; x < end; x += 16) {
+        uint8x16_t y8 = vld1q_u8(y + x);
+        uint8x16_t cb8 = vld1q_u8(cb + x);
+        uint8x16_t cr8 = vld1q_u8(cr + x);
+        uint8x8_t r_lo, g_lo, b_lo, r_hi, g_hi, b_hi;
+        ycc_to_rgb_8_neon(vget_low_u8(y8), vget_low_u8(cb8), vget_low_u8(cr8), r_lo, g_lo, b_lo);
+        ycc_to_rgb_8_neon(vget_high_u8(y8), vget_high_u8(cb8), vget_high_u8(cr8), r_hi, g_hi, b_hi);
+        store_pixels_neon(vcombine_u8(r_lo, r_hi), vcombine_u8(g_lo, g_hi), vcombine_u8(b_lo, b_hi),
+                          output + x * bpp, format);
+    }
+    ycc_to_rgb_scalar(y, cb, cr, output, end, width, format);
+}
+
+static void planar_to_rgb_neon(const unsigned char *r, const unsigned char *g, const unsigned char *b,
+                               unsigned char *output, int width, PixelFormat format) {
+    int bpp = bytes_per_pixel(format);
+    int end = width & ~15;
+    for (int x = 0; x < end; x += 16) {
+        store_pixels_neon(vld1q_u8(r + x), vld1q_u8(g + x), vld1q_u8(b + x), output + x * bpp, format);
+    }
+    planar_to_rgb_scalar(r, g, b, output, end, width, format);
+}
+
+#endif
+
+void ycc_to_rgb_row(const unsigned char *y, const unsigned char *cb, const unsigned char *cr,
+                    unsigned char *output, int width, PixelFormat format) {
+#if defined(COLOR_SSE2)
+    ycc_to_rgb_sse2(y, cb, cr, output, width, format);
+#elif defined(COLOR_NEON)
+    ycc_to_rgb_neon(y, cb, cr, output, width, format);
+#else
+    ycc_to_rgb_scalar(y, cb, cr, output, 0, width, format);
+#endif
+}
+
+void planar_to_rgb_row(const unsigned char *r, const unsigned char *g, const unsigned char *b,
+                       unsigned char *output, int width, PixelFormat format) {
+#if defined(COLOR_SSE2)
+    planar_to_rgb_sse2(r, g, b, output, width, format);
+#elif defined(COLOR_NEON)
+    planar_to_rgb_neon(r, g, b, output, width, format);
+#else
+    planar_to_rgb_scalar(r, g, b, output, 0, width, format);
+#endif
+}
+
+void gray_to_rgb_row(const unsigned char *y, unsigned char *output, int width, PixelFormat format) {
+    planar_to_rgb_row(y, y, y, output, width, format);
+}
+
+
+void upsample_h2_fancy(const unsigned char *input, int width, unsigned char *output) {
+    int i = 0;
+#if defined(COLOR_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i two = _mm_set1_epi16(2);
+    for (; i + 8 <= width; i += 8) {
+        __m128i current = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (input + i)), zero);
+        __m128i previous = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (input + i - 1)), zero);
+        __m128i next = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (input + i + 1)), zero);
+        __m128i current3 = _mm_add_epi16(current, _mm_add_epi16(current, current));
+        __m128i even = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(current3, previous), one), 2);
+        __m128i odd = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(current3, next), two), 2);
+        __m128i pixels = _mm_packus_epi16(_mm_unpacklo_epi16(even, odd), _mm_unpackhi_epi16(even, odd));
+        _mm_storeu_si128((__m128i *) (output + 2 * i), pixels);
+    }
+#endif
+    for (; i < width; i++) {
+        int current3 = input[i] * 3;
+        output[2 * i] = (unsigned char) ((current3 + input[i - 1] + 1) >> 2);
+        output[2 * i + 1] = (unsigned char) ((current3 + input[i + 1] + 2) >> 2);
+    }
+}
+
+void upsample_h2v2_fancy(const unsigned char *near, const unsigned char *far, int width, unsigned char *output) {
+    // Vertical pass first (3 * near + far), then the horizontal one on these column sums.
+    auto column_sum = [&](int i) { return near[i] * 3 + far[i]; };
+    int i = 0;
+#if defined(COLOR_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i seven = _mm_set1_epi16(7);
+    const __m128i eight = _mm_set1_epi16(8);
+    auto load_sums = [&](int offset) {
+        __m128i n = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (near + offset)), zero);
+        __m128i f = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (far + offset)), zero);
+        return _mm_add_epi16(_mm_add_epi16(n, _mm_add_epi16(n, n)), f);
+    };
+    for (; i + 8 <= width; i += 8) {
+        __m128i current = load_sums(i);
+        __m128i current3 = _mm_add_epi16(current, _mm_add_epi16(current, current));
+        __m128i even = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(current3, load_sums(i - 1)), eight), 4);
+        __m128i odd = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(current3, load_sums(i + 1)), seven), 4);
+        __m128i pixels = _mm_packus_epi16(_mm_unpacklo_epi16(even, odd), _mm_unpackhi_epi16(even, odd));
+        _mm_storeu_si128((__m128i *) (output + 2 * i), pixels);
+    }
+#endif
+    for (; i < width; i++) {
+        int current3 = column_sum(i) * 3;
+        output[2 * i] = (unsigned char) ((current3 + column_sum(i - 1) + 8) >> 4);
+        output[2 * i + 1] = (unsigned char) ((current3 + column_sum(i + 1) + 7) >> 4);
+    }
+}
+
+void upsample_v2_fancy(const unsigned char *near, const unsigned char *far, int width, int bias,
+                       unsigned char *output) {
+    int i = 0;
+#if defined(COLOR_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rounding = _mm_set1_epi16((short) bias);
+    for (; i + 8 <= width; i += 8) {
+        __m128i n = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (near + i)), zero);
+        __m128i f = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (far + i)), zero);
+        __m128i sum = _mm_add_epi16(_mm_add_epi16(n, _mm_add_epi16(n, n)), _mm_add_epi16(f, rounding));
+        _mm_storel_epi64((__m128i *) (output + i), _mm_packus_epi16(_mm_srli_epi16(sum, 2), zero));
+    }
+#endif
+    for (; i < width; i++) {
+        output[i] = (unsigned char) ((near[i] * 3 + far[i] + bias) >> 2);
+    }
+}
+
+static void upsample_h2_box(const unsigned char *input, int width, unsigned char *output) {
+    int i = 0;
+#if defined(COLOR_SSE2)
+    for (; i + 16 <= width; i += 16) {
+        __m128i samples = _mm_loadu_si128((const __m128i *) (input + i));
+        _mm_storeu_si128((__m128i *) (output + 2 * i), _mm_unpacklo_epi8(samples, samples));
+        _mm_storeu_si128((__m128i *) (output + 2 * i + 16), _mm_unpackhi_epi8(samples, samples));
+    }
+#endif
+    for (; i < width; i++) {
+        output[2 * i] = input[i];
+        output[2 * i + 1] = input[i];
+    }
+}
+
+
+ComponentRows::ComponentRows(int width, int height, int padded_width, int group_rows) {
+    reset(width, height, padded_width, group_rows);
+}
+
+void ComponentRows::reset(int width, int height, int padded_width, int group_rows) {
+    samples = width;
+    rows_nbr = height;
+    this->group_rows = group_rows;
+    // One sample of margin on each side, the rest keeps the rows 16 bytes apart.
+    row_stride = (padded_width + 2 + 15) & ~15;
+    rows.resize((size_t) 3 * group_rows * row_stride + 16);
+}
+
+const unsigned char *ComponentRows::row(int row) const {
+    row = std::clamp(row, 0, rows_nbr - 1);
+    int slot = (row / group_rows) % 3;
+    return rows.data() + ((size_t) slot * group_rows + row % group_rows) * row_stride + 1;
+}
+
+void ComponentRows::extend_edges(int mcu_row) {
+    unsigned char *first = group(mcu_row);
+    for (int r = 0; r < group_rows; r++) {
+        unsigned char *samples_row = first + (size_t) r * row_stride;
+        samples_row[-1] = samples_row[0];
+        samples_row[samples] = samples_row[samples - 1];
+    }
+}
+
+
+int component_block_size(const FrameHeader &frame, int component, int block_size) {
+    const FrameComponent &info = frame.components[component];
+    int size = block_size;
+    while (size < 8 && frame.h_max % (info.h * (size / block_size) * 2) == 0 &&
+           frame.v_max % (info.v * (size / block_size) * 2) == 0) {
+        size *= 2;
+    }
+    return size;
+}
+
+
+ColorConverter::Filter ColorConverter::select_filter(int h, int v) const {
+    bool h1 = h == frame.h_max;
+    bool v1 = v == frame.v_max;
+    bool h2 = h * 2 == frame.h_max;
+    bool v2 = v * 2 == frame.v_max;
+    if (h1 && v1) {
+        return Filter::None;
+    }
+    if (upsampling == Upsampling::Fancy && (h1 || h2) && (v1 || v2)) {
+        if (v1) {
+            return Filter::FancyH2;
+        }
+        return h2 ? Filter::FancyH2V2 : Filter::FancyV2;
+    }
+    if (h1) {
+        return Filter::BoxV;
+    }
+    return h2 ? Filter::BoxH2 : Filter::Generic;
+}
+
+ColorSpace color_space(const FrameHeader &frame) {
+    if (frame.components_nbr == 1) {
+        return ColorSpace::Gray;
+    }
+    if (frame.components_nbr != 3) {
+        throw std::runtime_error("Only grayscale and 3 components images can be converted");
+    }
+    // Adobe RGB files name their components R, G and B instead of 1, 2 and 3.
+    bool rgb = frame.components[0].id == 'R' && frame.components[1].id == 'G' && frame.components[2].id == 'B';
+    return rgb ? ColorSpace::RGB : ColorSpace::YCbCr;
+}
+
+ColorConverter::ColorConverter(const FrameHeader &frame, PixelFormat format, Upsampling upsampling, int block_size):
+frame(frame) {
+    reset(format, upsampling, block_size);
+}
+
+void ColorConverter::reset(PixelFormat format, Upsampling upsampling, int block_size) {
+    transform = color_space(frame) != ColorSpace::RGB;
+    this->format = format;
+    this->upsampling = upsampling;
+    width = (frame.width * block_size + 7) / 8;
+    for (int c = 0; c < frame.components_nbr; c++) {
+        int factor = component_block_size(frame, c, block_size) / block_size;
+        sampling[c] = {frame.components[c].h * factor, frame.components[c].v * factor};
+        filters[c] = select_filter(sampling[c][0], sampling[c][1]);
+        // Upsampled rows may go up to the end of the last MCU, plus some room for the SIMD stores.
+        scratch[c].resize((size_t) frame.mcus_x() * frame.h_max * block_size + 32);
+    }
+}
+
+const unsigned char *ColorConverter::upsample(const ComponentRows &rows, int component, int y) {
+    unsigned char *output = scratch[component].data();
+    switch (filters[component]) {
+        case Filter::None:
+            return rows.row(y);
+        case Filter::FancyH2:
+            upsample_h2_fancy(rows.row(y), rows.width(), output);
+            return output;
+        // The nearest chroma row is y / 2, the other neighbour is above it for even rows and below for odd ones.
+        // As in libjpeg, the rows reading the one above round down and the others up.
+        case Filter::FancyV2:
+            upsample_v2_fancy(rows.row(y / 2), rows.row(y % 2 == 0 ? y / 2 - 1 : y / 2 + 1), rows.width(),
+                              y % 2 == 0 ? 1 : 2, output);
+            return output;
+        case Filter::FancyH2V2:
+            upsample_h2v2_fancy(rows.row(y / 2), rows.row(y % 2 == 0 ? y / 2 - 1 : y / 2 + 1), rows.width(),
+                                output);
+            return output;
+        default:
+            break;
+    }
+
+    auto [h, v] = sampling[component];
+    const unsigned char *input = rows.row(y * v / frame.v_max);
+    if (filters[component] == Filter::BoxV) {
+        return input;
+    }
+    if (filters[component] == Filter::BoxH2) {
+        upsample_h2_box(input, rows.width(), output);
+        return output;
+    }
+    for (int x = 0; x < width; x++) {
+        output[x] = input[x * h / frame.h_max];
+    }
+    return output;
+}
+
+void ColorConverter::convert_row(const std::vector<ComponentRows> &components, int y, unsigned char *output) {
+    if (frame.components_nbr == 1) {
+        StageTimer timer {stats, &DecodeStats::color_ns};
+        gray_to_rgb_row(components[0].row(y), output, width, format);
+        return;
+    }
+    const unsigned char *c0;
+    const unsigned char *c1;
+    const unsigned char *c2;
+    {
+        StageTimer timer {stats, &DecodeStats::upsampling_ns};
+        c0 = upsample(components[0], 0, y);
+        c1 = upsample(components[1], 1, y);
+        c2 = upsample(components[2], 2, y);
+    }
+    StageTimer timer {stats, &DecodeStats::color_ns};
+    if (transform) {
+        ycc_to_rgb_row(c0, c1, c2, output, width, format);
+    } else {
+        planar_to_rgb_row(c0, c1, c2, output, width, format);
+    }
+}
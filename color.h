@@ -0,0 +1,113 @@
+#ifndef UNTITLED_COLOR_H
+#define UNTITLED_COLOR_H
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include "decode_stats.h"
+#include "jpeg_parser.h"
+
+enum class PixelFormat {RGB, RGBA, BGR};
+
+// How chroma planes are brought to the luma resolution. Fancy is the triangle filter of libjpeg, used for
+// 2x ratios only (anything else falls back to box).
+enum class Upsampling {Box, Fancy};
+
+int bytes_per_pixel(PixelFormat format);
+
+// What the components of a frame hold.
+enum class ColorSpace {Gray, YCbCr, RGB};
+// Throws std::runtime_error for frames that are neither grayscale nor made of 3 components (e.g. CMYK).
+ColorSpace color_space(const FrameHeader &frame);
+
+// Converts a row of full resolution Y, Cb and Cr samples (JFIF / BT.601 full range) to interleaved pixels.
+void ycc_to_rgb_row(const unsigned char *y, const unsigned char *cb, const unsigned char *cr,
+                    unsigned char *output, int width, PixelFormat format);
+// Converts a row of 3 samples per pixel without any color transform (Adobe RGB JPEGs).
+void planar_to_rgb_row(const unsigned char *r, const unsigned char *g, const unsigned char *b,
+                       unsigned char *output, int width, PixelFormat format);
+void gray_to_rgb_row(const unsigned char *y, unsigned char *output, int width, PixelFormat format);
+
+// Samples per block side output by the IDCT for component `component`, when decoding at `block_size` samples
+// per block side (8 / scale). Subsampled components get a larger IDCT, up to the full 8x8 one, so that they
+// need less upsampling and keep their resolution (e.g. no chroma upsampling at all for 4:2:0 at 1/2 scale).
+// This is what libjpeg does.
+int component_block_size(const FrameHeader &frame, int component, int block_size);
+
+// Horizontal 2x triangle filter. `input` must be readable at -1 and `width` (see ComponentRows).
+void upsample_h2_fancy(const unsigned char *input, int width, unsigned char *output);
+// 2x2 triangle filter, `near` being the closest input row and `far` the other neighbour.
+void upsample_h2v2_fancy(const unsigned char *near, const unsigned char *far, int width, unsigned char *output);
+// Vertical 2x triangle filter, rounding with `bias`: 1 for the rows whose `far` row is above, 2 for the others.
+void upsample_v2_fancy(const unsigned char *near, const unsigned char *far, int width, int bias,
+                       unsigned char *output);
+
+// Samples of one component, as output by the IDCT, for a sliding window of 3 MCU rows: the one being
+// converted and its neighbours, which the fancy upsampling reads across MCU row boundaries.
+// Every row has one readable sample before it and after the component width, see extend_edges().
+class ComponentRows {
+public:
+    // `width` and `height` are the size of the component in the image, `padded_width` the number of
+    // samples output by the IDCT for each row and `group_rows` the number of rows per MCU row.
+    ComponentRows(int width, int height, int padded_width, int group_rows);
+    // Same as constructing anew, but the storage is kept if it is large enough.
+    void reset(int width, int height, int padded_width, int group_rows);
+
+    // First row of MCU row `mcu_row`, subsequent rows being stride() bytes apart.
+    unsigned char *group(int mcu_row) {
+        return rows.data() + (size_t) (mcu_row % 3) * group_rows * row_stride + 1;
+    }
+    // Row at absolute index `row`, clamped to the rows of the image. Must be within the window.
+    const unsigned char *row(int row) const;
+    // Replicates the first and last samples of each row of MCU row `mcu_row` one sample outwards.
+    void extend_edges(int mcu_row);
+
+    int stride() const { return row_stride; }
+    int width() const { return samples; }
+    int height() const { return rows_nbr; }
+    int mcu_rows() const { return group_rows; }
+
+private:
+    int samples;
+    int rows_nbr;
+    int group_rows;
+    int row_stride;
+    std::vector<unsigned char> rows;
+};
+
+// Upsamples and color converts full rows of samples into interleaved pixels, one output row at a time so
+// that the upsampled chroma never leaves a row-sized scratch buffer.
+class ColorConverter {
+public:
+    // `block_size` is the number of samples per block side output by the IDCT, less than 8 for scaled decoding.
+    ColorConverter(const FrameHeader &frame, PixelFormat format, Upsampling upsampling, int block_size = 8);
+    // Reconfigures the converter for the current content of `frame`, keeping the scratch storage.
+    void reset(PixelFormat format, Upsampling upsampling, int block_size = 8);
+
+    void convert_row(const std::vector<ComponentRows> &components, int y, unsigned char *output);
+    // Where to add the time spent upsampling and converting, if anywhere (see decode_stats.h).
+    void set_stats(DecodeStats *stats) noexcept { this->stats = stats; }
+
+private:
+    const FrameHeader &frame;
+    PixelFormat format;
+    Upsampling upsampling;
+    // Number of pixels per output row.
+    int width;
+    // Sampling factors of the components, relative to the output. Those are the frame ones, unless scaled
+    // decoding reduces the components differently (see component_block_size()).
+    std::array<std::array<int, 2>, 4> sampling;
+    // Filter bringing each component to the output resolution, chosen by reset() for the whole image.
+    enum class Filter {None, FancyH2, FancyV2, FancyH2V2, BoxV, BoxH2, Generic};
+    std::array<Filter, 4> filters;
+    // Whether the components are Y, Cb and Cr rather than R, G and B.
+    bool transform;
+    std::array<std::vector<unsigned char>, 4> scratch;
+    DecodeStats *stats = nullptr;
+
+    Filter select_filter(int h, int v) const;
+    const unsigned char *upsample(const ComponentRows &rows, int component, int y);
+};
+
+#endif //UNTITLED_COLOR_H
@@ -0,0 +1,31 @@
+#include "cpu_features.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+static CpuFeatures detect_cpu_features() {
+    CpuFeatures features {false, false, false};
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    features.sse2 = __builtin_cpu_supports("sse2");
+    features.avx2 = __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 1);
+    features.sse2 = (info[3] & (1 << 26)) != 0;
+    bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+    __cpuidex(info, 7, 0);
+    features.avx2 = os_saves_ymm && (info[1] & (1 << 5)) != 0;
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+    // NEON is mandatory on AArch64, and on 32-bit ARM we only enable it when the compiler targets it.
+    features.neon = true;
+#endif
+    return features;
+}
+
+const CpuFeatures &cpu_features() {
+    static const CpuFeatures features = detect_cpu_features();
+    return features;
+}
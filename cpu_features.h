@@ -0,0 +1,13 @@
+#ifndef UNTITLED_CPU_FEATURES_H
+#define UNTITLED_CPU_FEATURES_H
+
+// Instruction sets usable by the SIMD kernels, detected once at startup.
+struct CpuFeatures {
+    bool sse2;
+    bool avx2;
+    bool neon;
+};
+
+const CpuFeatures &cpu_features();
+
+#endif //UNTITLED_CPU_FEATURES_H
@@ -0,0 +1,56 @@
+#ifndef UNTITLED_DECODE_STATS_H
+#define UNTITLED_DECODE_STATS_H
+
+#include <chrono>
+
+// With JPEG_DECODER_STATS defined (the CMake option of the same name), decoding measures the time spent in each
+// of its stages. Without it, the counters stay at 0 and the measuring compiles to nothing.
+#ifdef JPEG_DECODER_STATS
+constexpr bool collect_stats = true;
+#else
+constexpr bool collect_stats = false;
+#endif
+
+// Where the decoding of an image went, see JPEGEncoded::stats. Times are in nanoseconds.
+struct DecodeStats {
+    unsigned long long marker_ns;
+    // Huffman decoding of the scans.
+    unsigned long long entropy_ns;
+    unsigned long long idct_ns;
+    unsigned long long upsampling_ns;
+    unsigned long long color_ns;
+    // Size of the entropy-coded data of the scans, headers excluded.
+    unsigned long long entropy_bytes;
+    // Number of times a BitReader loaded more bytes into its buffer.
+    unsigned long long refills;
+};
+
+// Adds the time from its construction to its destruction to a counter of `stats`, unless `stats` is null.
+class StageTimer {
+public:
+    StageTimer(DecodeStats *stats, unsigned long long DecodeStats::*counter) noexcept:
+    stats(stats), counter(counter) {
+        if constexpr (collect_stats) {
+            if (stats != nullptr) {
+                start = std::chrono::steady_clock::now();
+            }
+        }
+    }
+    ~StageTimer() {
+        if constexpr (collect_stats) {
+            if (stats != nullptr) {
+                auto elapsed = std::chrono::steady_clock::now() - start;
+                stats->*counter += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+            }
+        }
+    }
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+
+private:
+    DecodeStats *stats;
+    unsigned long long DecodeStats::*counter;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif //UNTITLED_DECODE_STATS_H
@@ -0,0 +1,658 @@
+#include "decoder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+#include "bit_reader.h"
+#include "idct.h"
+#include "scan_decoder.h"
+
+MCURowRenderer::MCURowRenderer(const FrameHeader &frame, const std::array<QuantizationTable, 4> &q_tables,
+                               PixelFormat format, Upsampling upsampling, Scale scale):
+frame(frame), q_tables(q_tables) {
+    reset(format, upsampling, scale);
+}
+
+MCURowRenderer::MCURowRenderer(const FrameHeader &frame, const std::array<QuantizationTable, 4> &q_tables,
+                               Scale scale):
+frame(frame), q_tables(q_tables) {
+    reset_samples(scale);
+}
+
+void MCURowRenderer::reset(PixelFormat format, Upsampling upsampling, Scale scale) {
+    if (converter) {
+        converter->reset(format, upsampling, 8 / (int) scale);
+    } else {
+        converter.emplace(frame, format, upsampling, 8 / (int) scale);
+        converter->set_stats(stats);
+    }
+    reset_samples(scale);
+}
+
+void MCURowRenderer::reset_samples(Scale scale) {
+    block_size = 8 / (int) scale;
+    // Sizes are rounded up, as libjpeg does.
+    output_width = (frame.width * block_size + 7) / 8;
+    output_height = (frame.height * block_size + 7) / 8;
+    components.resize(frame.components_nbr, ComponentRows {0, 0, 0, 0});
+    for (int c = 0; c < frame.components_nbr; c++) {
+        const FrameComponent &component = frame.components[c];
+        int size = component_block_size(frame, c, block_size);
+        block_sizes[c] = size;
+        int width = (frame.width * component.h * size + frame.h_max * 8 - 1) / (frame.h_max * 8);
+        int height = (frame.height * component.v * size + frame.v_max * 8 - 1) / (frame.v_max * 8);
+        int padded_width = frame.mcus_x() * component.h * size;
+        components[c].reset(width, height, padded_width, component.v * size);
+    }
+}
+
+int MCURowRenderer::end_row(int mcu_row) const {
+    return std::min<int>(first_row(mcu_row + 1), output_height);
+}
+
+void MCURowRenderer::transform(const std::vector<ComponentCoefficients> &coefficients, int mcu_row) {
+    transform(coefficients, mcu_row, mcu_row);
+}
+
+void MCURowRenderer::transform(const std::vector<ComponentCoefficients> &coefficients, int mcu_row,
+                               int coefficient_row) {
+    StageTimer timer {stats, &DecodeStats::idct_ns};
+    for (int c = 0; c < frame.components_nbr; c++) {
+        const FrameComponent &component = frame.components[c];
+        ComponentRows &rows = components[c];
+        int size = block_sizes[c];
+        for (int v = 0; v < component.v; v++) {
+            inverse_transform_block_row(coefficients[c], coefficient_row * component.v + v, q_tables[component.q_table_id],
+                                        rows.group(mcu_row) + (size_t) v * size * rows.stride(), rows.stride(), size);
+        }
+        rows.extend_edges(mcu_row);
+    }
+}
+
+void MCURowRenderer::set_stats(DecodeStats *stats) noexcept {
+    this->stats = stats;
+    if (converter) {
+        converter->set_stats(stats);
+    }
+}
+
+void MCURowRenderer::convert(int mcu_row, unsigned char *pixels, size_t row_size) {
+    convert_band(mcu_row, pixels + (size_t) first_row(mcu_row) * row_size, row_size);
+}
+
+void MCURowRenderer::convert_band(int mcu_row, unsigned char *band, size_t row_size) {
+    int first = first_row(mcu_row);
+    for (int y = first; y < end_row(mcu_row); y++) {
+        converter->convert_row(components, y, band + (size_t) (y - first) * row_size);
+    }
+}
+
+
+namespace {
+
+// Decodes the scan whose header was just parsed and the following ones, into the coefficients of the whole frame.
+void decode_scans(JPEGParser &parser, JPEGEncoded &encoded, const ScanHeader &scan,
+                  std::span<const unsigned char> data, ThreadPool *pool = nullptr) {
+    encoded.allocate_coefficients();
+    ScanDecoder decoder {encoded.frame, scan, parser.dc_tables(), parser.ac_tables(), encoded.restart_interval};
+    parser.advance(decoder.decode(data.data() + parser.position(), data.size() - parser.position(),
+                                  encoded.coefficients, pool));
+    parser.parse(encoded);
+}
+
+// MCU rows rendered by a pipeline stage at once. Each stage also transforms the row before its own, which the
+// upsampling of its first row reads, so larger stripes waste less work but leave less to do in parallel.
+constexpr int PIPELINE_STRIPE_ROWS = 8;
+
+// Progress of a pipelined decoding, shared by the thread entropy decoding the scan and the ones rendering it.
+// Nothing but atomics: rendering threads only wait for the MCU rows they need to be published.
+struct Pipeline {
+    explicit Pipeline(int mcus_y):
+    mcus_y(mcus_y), stripes((mcus_y + PIPELINE_STRIPE_ROWS - 1) / PIPELINE_STRIPE_ROWS) {}
+
+    // Of the image being decoded, fixed when the pipeline is set up, so that they can be read without the image.
+    const int mcus_y;
+    const int stripes;
+    // MCU rows entropy decoded so far, their coefficients being complete and no longer written to.
+    std::atomic<int> decoded_rows {0};
+    // Set, along with decoded_rows to all the rows, when entropy decoding fails: the stripes left are skipped.
+    std::atomic<bool> failed {false};
+    std::atomic<int> next_stripe {0};
+    std::atomic<int> finished_stripes {0};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    void publish(int rows) {
+        decoded_rows.store(rows, std::memory_order_release);
+        decoded_rows.notify_all();
+    }
+    // Returns false if the row will never be decoded.
+    bool wait_for(int mcu_row) {
+        int decoded = decoded_rows.load(std::memory_order_acquire);
+        while (decoded <= mcu_row) {
+            decoded_rows.wait(decoded, std::memory_order_acquire);
+            decoded = decoded_rows.load(std::memory_order_acquire);
+        }
+        return !failed.load(std::memory_order_relaxed);
+    }
+};
+
+// Renders stripes of MCU rows as they are entropy decoded, taking the first stripe no one took yet until there
+// is none left. The renderer is only constructed when needed. `encoded` and `pixels` are only touched once a
+// stripe is taken: the decoding they belong to waits for the stripes taken, not for the calls of the pool.
+void render_stripes(Pipeline &pipeline, std::optional<MCURowRenderer> &renderer, const JPEGEncoded &encoded,
+                    PixelFormat format, Upsampling upsampling, Scale scale, unsigned char *pixels, size_t row_size) {
+    int mcus_y = pipeline.mcus_y;
+    int stripe;
+    while ((stripe = pipeline.next_stripe.fetch_add(1)) < pipeline.stripes) {
+        try {
+            if (!renderer) {
+                renderer.emplace(encoded.frame, encoded.q_tables, format, upsampling, scale);
+            }
+            int first = stripe * PIPELINE_STRIPE_ROWS;
+            int end = std::min(first + PIPELINE_STRIPE_ROWS, mcus_y);
+            bool decoded = true;
+            for (int mcu_row = std::max(first - 1, 0); decoded && mcu_row < std::min(end + 1, mcus_y); mcu_row++) {
+                decoded = pipeline.wait_for(mcu_row);
+                if (decoded) {
+                    renderer->transform(encoded.coefficients, mcu_row);
+                    if (mcu_row > first) {
+                        renderer->convert(mcu_row - 1, pixels, row_size);
+                    }
+                }
+            }
+            if (decoded && end == mcus_y) {
+                renderer->convert(mcus_y - 1, pixels, row_size);
+            }
+        } catch (...) {
+            std::lock_guard lock {pipeline.error_mutex};
+            if (!pipeline.error) {
+                pipeline.error = std::current_exception();
+            }
+        }
+        pipeline.finished_stripes.fetch_add(1, std::memory_order_release);
+        pipeline.finished_stripes.notify_all();
+    }
+}
+
+void render(MCURowRenderer &renderer, const JPEGEncoded &encoded, unsigned char *pixels, size_t row_size) {
+    // An MCU row is converted once the next one is transformed.
+    int mcus_y = encoded.frame.mcus_y();
+    for (int mcu_row = 0; mcu_row < mcus_y; mcu_row++) {
+        renderer.transform(encoded.coefficients, mcu_row);
+        if (mcu_row > 0) {
+            renderer.convert(mcu_row - 1, pixels, row_size);
+        }
+    }
+    renderer.convert(mcus_y - 1, pixels, row_size);
+}
+
+}
+
+Image decode_image(const JPEGEncoded &encoded, PixelFormat format, Upsampling upsampling, Scale scale) {
+    const FrameHeader &frame = encoded.frame;
+    if (frame.components_nbr == 0) {
+        throw std::runtime_error("No frame to decode");
+    }
+    MCURowRenderer renderer {frame, encoded.q_tables, format, upsampling, scale};
+
+    size_t row_size = (size_t) renderer.width() * bytes_per_pixel(format);
+    Image image {renderer.width(), renderer.height(), format,
+                 std::vector<unsigned char>(row_size * renderer.height())};
+    render(renderer, encoded, image.pixels.data(), row_size);
+    return image;
+}
+
+
+Decoder::Decoder(PixelFormat format, Upsampling upsampling, Scale scale):
+format(format), upsampling(upsampling), scale(scale), parser(std::span<const unsigned char> {}), parsed {},
+image {0, 0, format, {}} {}
+
+void Decoder::reset() {
+    reset(format, upsampling, scale);
+}
+
+void Decoder::reset(PixelFormat format, Upsampling upsampling, Scale scale) {
+    this->format = format;
+    this->upsampling = upsampling;
+    this->scale = scale;
+    parser.reset({});
+    parsed.reset();
+    image.width = 0;
+    image.height = 0;
+    image.format = format;
+    image.pixels.clear();
+}
+
+const Image &Decoder::decode(std::span<const unsigned char> data) {
+    return decode(data, {});
+}
+
+const Image &Decoder::decode(std::span<const unsigned char> data, const ScanCallback &on_scan) {
+    reset();
+    parser.reset(data);
+    if (!on_scan) {
+        if (pipelined) {
+            decode_pipelined(data);
+        } else {
+            parser.parse(parsed);
+            render_image();
+        }
+        return image;
+    }
+
+    // The image rendered after the last scan is the final one.
+    bool rendered = false;
+    parser.parse(parsed, [&] {
+        render_image();
+        rendered = true;
+        on_scan(image);
+    });
+    if (!rendered) {
+        render_image();
+    }
+    return image;
+}
+
+void Decoder::set_thread_pool(ThreadPool *pool) noexcept {
+    thread_pool = pool;
+    parser.set_thread_pool(pool);
+}
+
+size_t Decoder::prepare_image() {
+    const FrameHeader &frame = parsed.frame;
+    if (frame.components_nbr == 0) {
+        throw std::runtime_error("No frame to decode");
+    }
+    if (renderer) {
+        renderer->reset(format, upsampling, scale);
+    } else {
+        renderer.emplace(frame, parsed.q_tables, format, upsampling, scale);
+        renderer->set_stats(&parsed.stats);
+    }
+
+    size_t row_size = (size_t) renderer->width() * bytes_per_pixel(format);
+    image.width = renderer->width();
+    image.height = renderer->height();
+    // Every pixel is written, the previous content does not need to be cleared.
+    image.pixels.resize(row_size * renderer->height());
+    return row_size;
+}
+
+void Decoder::render_image() {
+    size_t row_size = prepare_image();
+    render(*renderer, parsed, image.pixels.data(), row_size);
+}
+
+void Decoder::decode_pipelined(std::span<const unsigned char> data) {
+    ScanHeader scan {};
+    unsigned char marker;
+    {
+        StageTimer timer {&parsed.stats, &DecodeStats::marker_ns};
+        do {
+            marker = parser.parse_segment(parsed, scan);
+        } while (marker != 0 && marker != 0xd9 && marker != 0xda);
+    }
+    const FrameHeader &frame = parsed.frame;
+    if (marker != 0xda) {
+        // Without scan, whatever is left is parsed as decode() does, to render the (blank) frame if any.
+        if (frame.components_nbr != 0) {
+            parsed.allocate_coefficients();
+        }
+        parser.parse(parsed);
+        render_image();
+        return;
+    }
+    ThreadPool &pool = thread_pool != nullptr ? *thread_pool : ThreadPool::shared();
+    if (frame.progressive || scan.components_nbr != frame.components_nbr || pool.size() == 1) {
+        ThreadPool *interval_pool = thread_pool;
+        if (interval_pool == nullptr && parsed.restart_interval != 0) {
+            interval_pool = &ThreadPool::shared();
+        }
+        decode_scans(parser, parsed, scan, data, interval_pool);
+        render_image();
+        return;
+    }
+
+    parsed.allocate_coefficients();
+    size_t row_size = prepare_image();
+    // Once every stripe is taken, the iterations still to run on the pool only touch the pipeline, so the decoder
+    // may go away (or decode the next image) as soon as the stripes are rendered. Nothing else is read before
+    // taking a stripe, see render_stripes().
+    int mcus_y = frame.mcus_y();
+    auto pipeline = std::make_shared<Pipeline>(mcus_y);
+    unsigned char *pixels = image.pixels.data();
+    pool.run_async(pool.size() - 1, [pipeline, encoded = &parsed, format = format, upsampling = upsampling,
+                                     scale = scale, pixels, row_size](size_t) {
+        std::optional<MCURowRenderer> stage_renderer;
+        render_stripes(*pipeline, stage_renderer, *encoded, format, upsampling, scale, pixels, row_size);
+    });
+
+    // Entropy decoding on this thread, which renders what is left afterwards.
+    std::exception_ptr error;
+    ScanDecoder decoder {frame, scan, parser.dc_tables(), parser.ac_tables(), parsed.restart_interval};
+    BitReader reader {data.data() + parser.position(), data.size() - parser.position()};
+    try {
+        StageTimer timer {&parsed.stats, &DecodeStats::entropy_ns};
+        // A frame with a single component has a single block per MCU, so its MCU rows span several scan rows.
+        int scan_rows = decoder.mcu_rows();
+        int rows_per_mcu_row = frame.components_nbr == 1 ? frame.components[0].v : 1;
+        for (int scan_row = 0; scan_row < scan_rows; scan_row++) {
+            decoder.decode_mcu_row(reader, scan_row, parsed.coefficients);
+            if ((scan_row + 1) % rows_per_mcu_row == 0) {
+                pipeline->publish((scan_row + 1) / rows_per_mcu_row);
+            }
+        }
+    } catch (...) {
+        error = std::current_exception();
+        pipeline->failed.store(true, std::memory_order_relaxed);
+    }
+    pipeline->publish(mcus_y);
+
+    // The renderer of the decoder, unlike the ones of the pool, adds to the stats.
+    renderer->reset(format, upsampling, scale);
+    render_stripes(*pipeline, renderer, parsed, format, upsampling, scale, pixels, row_size);
+    int finished = pipeline->finished_stripes.load(std::memory_order_acquire);
+    while (finished < pipeline->stripes) {
+        pipeline->finished_stripes.wait(finished, std::memory_order_acquire);
+        finished = pipeline->finished_stripes.load(std::memory_order_acquire);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    if (pipeline->error) {
+        std::rethrow_exception(pipeline->error);
+    }
+
+    size_t length = ScanDecoder::scan_end(reader, data.data() + parser.position(), data.size() - parser.position());
+    if constexpr (collect_stats) {
+        parsed.stats.entropy_bytes += length;
+    }
+    parser.advance(length);
+    parser.parse(parsed);
+}
+
+Image Decoder::take_image() {
+    Image taken = std::move(image);
+    image = Image {0, 0, format, {}};
+    return taken;
+}
+
+
+Image decode_region(std::span<const unsigned char> data, Region region, PixelFormat format, Upsampling upsampling,
+                    Scale scale, const ScanIndex *index) {
+    JPEGParser parser {data};
+    JPEGEncoded encoded {};
+    ScanHeader scan {};
+    parser.parse_until_scan(encoded, scan);
+    const FrameHeader &frame = encoded.frame;
+    if (index != nullptr && (index->file_size != data.size() || index->scan_offset != parser.position())) {
+        throw std::runtime_error("Scan index of another file");
+    }
+
+    int block_size = 8 / (int) scale;
+    int x0 = std::max(region.x, 0);
+    int y0 = std::max(region.y, 0);
+    int x1 = std::min(region.x + region.width, (frame.width * block_size + 7) / 8);
+    int y1 = std::min(region.y + region.height, (frame.height * block_size + 7) / 8);
+    if (x1 <= x0 || y1 <= y0) {
+        throw std::runtime_error("Empty region");
+    }
+
+    // One more MCU on each side, as the upsampling of the edges of the region reads the neighbouring samples.
+    int mcu_width = frame.h_max * block_size;
+    int mcu_height = frame.v_max * block_size;
+    MCURegion mcus {std::max(x0 / mcu_width - 1, 0), std::max(y0 / mcu_height - 1, 0),
+                    std::min((x1 + mcu_width - 1) / mcu_width + 1, frame.mcus_x()),
+                    std::min((y1 + mcu_height - 1) / mcu_height + 1, frame.mcus_y())};
+    // These MCUs are rendered as a frame of their own.
+    FrameHeader window = frame;
+    window.width = (unsigned short) (std::min<int>(frame.width, mcus.x1 * frame.h_max * 8) -
+                                     mcus.x0 * frame.h_max * 8);
+    window.height = (unsigned short) (std::min<int>(frame.height, mcus.y1 * frame.v_max * 8) -
+                                      mcus.y0 * frame.v_max * 8);
+
+    std::vector<ComponentCoefficients> coefficients;
+    for (int c = 0; c < frame.components_nbr; c++) {
+        coefficients.push_back(ComponentCoefficients::allocate((mcus.x1 - mcus.x0) * frame.components[c].h,
+                                                               (mcus.y1 - mcus.y0) * frame.components[c].v,
+                                                               encoded.arena));
+    }
+    if (!frame.progressive && scan.components_nbr == frame.components_nbr) {
+        ScanDecoder decoder {frame, scan, parser.dc_tables(), parser.ac_tables(), encoded.restart_interval};
+        ThreadPool *pool = encoded.restart_interval != 0 ? &ThreadPool::shared() : nullptr;
+        std::span<const ScanDecoder::ResumePoint> points;
+        if (index != nullptr) {
+            points = index->points;
+        }
+        decoder.decode_region(data.data() + parser.position(), data.size() - parser.position(), mcus, coefficients,
+                              pool, points);
+    } else {
+        // Every scan has to be decoded, then the blocks of the region are taken out of the whole frame.
+        decode_scans(parser, encoded, scan, data);
+        for (int c = 0; c < frame.components_nbr; c++) {
+            ComponentCoefficients &component = coefficients[c];
+            int bx = mcus.x0 * frame.components[c].h;
+            int by = mcus.y0 * frame.components[c].v;
+            for (int row = 0; row < component.blocks_y; row++) {
+                const short *source = encoded.coefficients[c].block(bx, by + row);
+                std::copy(source, source + (size_t) component.blocks_x * 64, component.block(0, row));
+            }
+        }
+    }
+
+    MCURowRenderer renderer {window, encoded.q_tables, format, upsampling, scale};
+    int bpp = bytes_per_pixel(format);
+    size_t row_size = (size_t) (x1 - x0) * bpp;
+    Image image {x1 - x0, y1 - y0, format, std::vector<unsigned char>(row_size * (y1 - y0))};
+    size_t band_row_size = (size_t) renderer.width() * bpp;
+    std::vector<unsigned char> band(band_row_size * renderer.first_row(1));
+    // Position of the window in the output.
+    int origin_x = mcus.x0 * mcu_width;
+    int origin_y = mcus.y0 * mcu_height;
+    auto emit = [&](int mcu_row) {
+        renderer.convert_band(mcu_row, band.data(), band_row_size);
+        int first = renderer.first_row(mcu_row) + origin_y;
+        int end = std::min(renderer.end_row(mcu_row) + origin_y, y1);
+        for (int y = std::max(first, y0); y < end; y++) {
+            const unsigned char *source = band.data() + (size_t) (y - first) * band_row_size +
+                                          (size_t) (x0 - origin_x) * bpp;
+            std::copy(source, source + row_size, image.pixels.data() + (size_t) (y - y0) * row_size);
+        }
+    };
+    int window_mcus_y = mcus.y1 - mcus.y0;
+    for (int mcu_row = 0; mcu_row < window_mcus_y; mcu_row++) {
+        renderer.transform(coefficients, mcu_row);
+        if (mcu_row > 0) {
+            emit(mcu_row - 1);
+        }
+    }
+    emit(window_mcus_y - 1);
+    return image;
+}
+
+namespace {
+
+// Transforms every MCU row of the file whose first scan header was just parsed, calling `emit` with each row
+// once the next one (which the upsampling reads) is transformed too. Single scans holding every component are
+// entropy decoded an MCU row at a time, just in time; other files need the coefficients of the whole frame.
+void transform_rows(JPEGParser &parser, JPEGEncoded &encoded, const ScanHeader &scan,
+                    std::span<const unsigned char> data, MCURowRenderer &renderer,
+                    const std::function<void(int mcu_row)> &emit) {
+    const FrameHeader &frame = encoded.frame;
+    int mcus_y = frame.mcus_y();
+
+    if (frame.progressive || scan.components_nbr != frame.components_nbr) {
+        // No MCU row is complete before the last scan, so all of them are kept.
+        decode_scans(parser, encoded, scan, data);
+        for (int mcu_row = 0; mcu_row < mcus_y; mcu_row++) {
+            renderer.transform(encoded.coefficients, mcu_row);
+            if (mcu_row > 0) {
+                emit(mcu_row - 1);
+            }
+        }
+        emit(mcus_y - 1);
+        return;
+    }
+
+    // Coefficients of a single MCU row, transformed as soon as they are decoded.
+    std::vector<ComponentCoefficients> coefficients;
+    for (int c = 0; c < frame.components_nbr; c++) {
+        coefficients.push_back(ComponentCoefficients::allocate(frame.mcus_x() * frame.components[c].h,
+                                                               frame.components[c].v, encoded.arena));
+    }
+    ScanDecoder decoder {frame, scan, parser.dc_tables(), parser.ac_tables(), encoded.restart_interval};
+    BitReader reader {data.data() + parser.position(), data.size() - parser.position()};
+    // A frame with a single component has a single block per MCU, so its MCU rows span several scan rows.
+    int scan_rows = decoder.mcu_rows();
+    int rows_per_mcu_row = frame.components_nbr == 1 ? frame.components[0].v : 1;
+    int scan_row = 0;
+    for (int mcu_row = 0; mcu_row < mcus_y; mcu_row++) {
+        for (int row = 0; row < rows_per_mcu_row && scan_row < scan_rows; row++, scan_row++) {
+            decoder.decode_mcu_row(reader, row, coefficients);
+        }
+        renderer.transform(coefficients, mcu_row, 0);
+        if (mcu_row > 0) {
+            emit(mcu_row - 1);
+        }
+    }
+    emit(mcus_y - 1);
+    // As JPEGParser::parse() does, once the rows decoded from what the scan has are out.
+    if (reader.reached_end()) {
+        throw JPEGError("Truncated file", data.size());
+    }
+}
+
+// How the samples of a component map to those of a plane in one direction: each sample of the plane is the
+// mean of `average` samples of the component, or each sample of the component is repeated `repeat` times.
+struct PlaneSampling {
+    int average;
+    int repeat;
+};
+
+// For a component with sampling factor `factor` (out of `max`), and a plane dividing the image by `divisor`.
+PlaneSampling plane_sampling(int factor, int max, int divisor) {
+    int samples = factor * divisor;
+    if (samples % max == 0) {
+        return PlaneSampling {samples / max, 1};
+    }
+    if (max % samples == 0) {
+        return PlaneSampling {1, max / samples};
+    }
+    throw std::runtime_error("Unsupported subsampling for planar output");
+}
+
+// Writes `width` samples of row `y` of a plane, `step` bytes apart (2 for the interleaved chroma of NV12).
+template<int step>
+void write_plane_row(const ComponentRows &rows, PlaneSampling horizontal, PlaneSampling vertical, int y,
+                     unsigned char *output, int width) {
+    int source_y = y * vertical.average / vertical.repeat;
+    const unsigned char *row = rows.row(source_y);
+    if (horizontal.average == 1 && horizontal.repeat == 1 && vertical.average == 1) {
+        // The samples as they are, e.g. all of them for 4:2:0.
+        for (int x = 0; x < width; x++) {
+            output[x * step] = row[x];
+        }
+        return;
+    }
+    // Rows are readable one sample past the width of the component, the end of the last 2x2 average when the
+    // width is odd. The second row of an average is in the same MCU row, whose rows are even.
+    const unsigned char *next = vertical.average == 2 ? rows.row(source_y + 1) : row;
+    if (horizontal.average == 2) {
+        for (int x = 0; x < width; x++) {
+            int sum = row[2 * x] + row[2 * x + 1] + next[2 * x] + next[2 * x + 1];
+            output[x * step] = (unsigned char) ((sum + 2) >> 2);
+        }
+    } else {
+        for (int x = 0; x < width; x++) {
+            int source_x = x / horizontal.repeat;
+            output[x * step] = (unsigned char) ((row[source_x] + next[source_x] + 1) >> 1);
+        }
+    }
+}
+
+}
+
+void decode_rows(std::span<const unsigned char> data, const RowCallback &callback, PixelFormat format,
+                 Upsampling upsampling, Scale scale) {
+    JPEGParser parser {data};
+    JPEGEncoded encoded {};
+    ScanHeader scan {};
+    parser.parse_until_scan(encoded, scan);
+
+    MCURowRenderer renderer {encoded.frame, encoded.q_tables, format, upsampling, scale};
+    size_t row_size = (size_t) renderer.width() * bytes_per_pixel(format);
+    std::vector<unsigned char> band(row_size * renderer.first_row(1));
+    transform_rows(parser, encoded, scan, data, renderer, [&](int mcu_row) {
+        renderer.convert_band(mcu_row, band.data(), row_size);
+        int first = renderer.first_row(mcu_row);
+        callback(RowBand {renderer.width(), renderer.height(), format, first, renderer.end_row(mcu_row) - first,
+                          band.data(), row_size});
+    });
+}
+
+void decode_planar(std::span<const unsigned char> data, const PlanarOutput &output) {
+    JPEGParser parser {data};
+    JPEGEncoded encoded {};
+    ScanHeader scan {};
+    parser.parse_until_scan(encoded, scan);
+
+    const FrameHeader &frame = encoded.frame;
+    if (color_space(frame) == ColorSpace::RGB) {
+        throw std::runtime_error("Only YCbCr and grayscale images can be decoded to planes");
+    }
+    // The samples are taken as they are, without color conversion.
+    MCURowRenderer renderer {frame, encoded.q_tables};
+    int width = frame.width;
+    int chroma_width = (width + 1) / 2;
+    bool nv12 = output.format == PlanarFormat::NV12;
+    auto check = [](const Plane &plane, size_t row_size) {
+        if (plane.data == nullptr || plane.stride < row_size) {
+            throw std::runtime_error("Plane too small for the image");
+        }
+    };
+    check(output.y, width);
+    check(output.cb, nv12 ? 2 * (size_t) chroma_width : chroma_width);
+    if (!nv12) {
+        check(output.cr, chroma_width);
+    }
+
+    std::array<std::array<PlaneSampling, 2>, 3> sampling {};
+    for (int c = 0; c < frame.components_nbr; c++) {
+        int divisor = c == 0 ? 1 : 2;
+        sampling[c] = {plane_sampling(frame.components[c].h, frame.h_max, divisor),
+                       plane_sampling(frame.components[c].v, frame.v_max, divisor)};
+    }
+    // Cb then Cr, into their own planes or interleaved.
+    std::array<Plane, 2> chroma_planes {output.cb, nv12 ? Plane {output.cb.data + 1, output.cb.stride} : output.cr};
+
+    transform_rows(parser, encoded, scan, data, renderer, [&](int mcu_row) {
+        int first = renderer.first_row(mcu_row);
+        int end = renderer.end_row(mcu_row);
+        for (int y = first; y < end; y++) {
+            write_plane_row<1>(renderer.component_rows(0), sampling[0][0], sampling[0][1], y,
+                               output.y.data + (size_t) y * output.y.stride, width);
+        }
+        // MCU rows start on even rows, so each chroma row is in a single one.
+        for (int y = first / 2; y < (end + 1) / 2; y++) {
+            for (int c = 0; c < 2; c++) {
+                unsigned char *row = chroma_planes[c].data + (size_t) y * chroma_planes[c].stride;
+                if (frame.components_nbr == 1) {
+                    for (int x = 0; x < chroma_width; x++) {
+                        row[x * (nv12 ? 2 : 1)] = 128;
+                    }
+                } else if (nv12) {
+                    write_plane_row<2>(renderer.component_rows(c + 1), sampling[c + 1][0], sampling[c + 1][1], y,
+                                       row, chroma_width);
+                } else {
+                    write_plane_row<1>(renderer.component_rows(c + 1), sampling[c + 1][0], sampling[c + 1][1], y,
+                                       row, chroma_width);
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,225 @@
+#ifndef UNTITLED_DECODER_H
+#define UNTITLED_DECODER_H
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "color.h"
+#include "jpeg_parser.h"
+#include "scan_index.h"
+
+// Scaled decoding divides both dimensions (rounded up) by 2, 4 or 8 by only computing the low frequencies of
+// each block, with a 4x4, 2x2 or 1x1 (DC only) IDCT. The work after entropy decoding shrinks accordingly.
+enum class Scale {Full = 1, Half = 2, Quarter = 4, Eighth = 8};
+
+struct Image {
+    int width;
+    int height;
+    PixelFormat format;
+    // Rows of width * bytes_per_pixel(format) bytes, without padding.
+    std::vector<unsigned char> pixels;
+};
+
+// Turns the coefficients of successive MCU rows into rows of pixels. Only three MCU rows of samples per
+// component are kept, and chroma is upsampled on the fly for each output row.
+class MCURowRenderer {
+public:
+    MCURowRenderer(const FrameHeader &frame, const std::array<QuantizationTable, 4> &q_tables,
+                   PixelFormat format, Upsampling upsampling, Scale scale = Scale::Full);
+    // Only inverse transforms, for callers reading the samples with component_rows(). convert() and
+    // convert_band() must not be called, unless a reset() sets up the color conversion.
+    MCURowRenderer(const FrameHeader &frame, const std::array<QuantizationTable, 4> &q_tables,
+                   Scale scale = Scale::Full);
+    // Reconfigures the renderer for the current content of the frame header and tables it was constructed
+    // with, e.g. once another image has been parsed into the same JPEGEncoded. Buffers are reused.
+    void reset(PixelFormat format, Upsampling upsampling, Scale scale = Scale::Full);
+
+    // Inverse transforms MCU row `mcu_row`. MCU rows must be transformed in order.
+    void transform(const std::vector<ComponentCoefficients> &coefficients, int mcu_row);
+    // Same, with the coefficients of the MCU row stored at MCU row `coefficient_row`, e.g. 0 for a buffer
+    // holding a single MCU row.
+    void transform(const std::vector<ComponentCoefficients> &coefficients, int mcu_row, int coefficient_row);
+    // Writes the pixel rows of MCU row `mcu_row` at `pixels + y * row_size`, for y in [first_row, end_row).
+    // The MCU row must have been transformed, as well as the next one (if any), which the fancy upsampling reads.
+    void convert(int mcu_row, unsigned char *pixels, size_t row_size);
+    // Same, but writes row first_row at `band`, which holds the rows of a single MCU row.
+    void convert_band(int mcu_row, unsigned char *band, size_t row_size);
+
+    // Samples of component `c` for the last three MCU rows transformed, as they were output by the IDCT.
+    const ComponentRows &component_rows(int c) const { return components[c]; }
+
+    int first_row(int mcu_row) const { return mcu_row * frame.v_max * block_size; }
+    int end_row(int mcu_row) const;
+    // Size of the output, which is the size of the frame divided by the scale.
+    int width() const { return output_width; }
+    int height() const { return output_height; }
+    // Where to add the time spent in each stage, if anywhere (see decode_stats.h).
+    void set_stats(DecodeStats *stats) noexcept;
+
+private:
+    const FrameHeader &frame;
+    const std::array<QuantizationTable, 4> &q_tables;
+    // Samples per block side, for the components at full resolution and for each of them.
+    int block_size;
+    std::array<int, 4> block_sizes;
+    int output_width;
+    int output_height;
+    // Not for the renderers only transforming.
+    std::optional<ColorConverter> converter;
+    std::vector<ComponentRows> components;
+    DecodeStats *stats = nullptr;
+
+    // Sets up the sample rows of the components, for `scale`.
+    void reset_samples(Scale scale);
+};
+
+// Long-lived decoder for many images in a row. The coefficients, sample rows and pixels of an image are kept
+// for the next one, so that once they have grown to the size of the largest image, decoding does not allocate.
+//
+//     Decoder decoder;
+//     for (...) {
+//         const Image &image = decoder.decode(file);
+//     }
+class Decoder {
+public:
+    explicit Decoder(PixelFormat format = PixelFormat::RGB, Upsampling upsampling = Upsampling::Fancy,
+                     Scale scale = Scale::Full);
+    // The renderer refers to the frame header and tables of `encoded`, which must not move.
+    Decoder(const Decoder &) = delete;
+    Decoder &operator=(const Decoder &) = delete;
+
+    // Decodes a whole file, which is not copied. The image stays valid until the next decode() or reset().
+    // Throws JPEGError if the file is truncated, as JPEGParser::parse() does.
+    const Image &decode(std::span<const unsigned char> data);
+    // Called after each scan with the image rendered from the coefficients decoded so far: for a progressive
+    // file, a preview getting sharper at each scan. The image passed after the last scan is the final one.
+    using ScanCallback = std::function<void(const Image &image)>;
+    // Same, rendering the image after each scan for `on_scan`.
+    const Image &decode(std::span<const unsigned char> data, const ScanCallback &on_scan);
+    // Forgets the previous image (but keeps its buffers), optionally changing the output settings.
+    // decode() starts with a reset, so this is only needed to drop references to the previous data.
+    void reset();
+    void reset(PixelFormat format, Upsampling upsampling, Scale scale = Scale::Full);
+
+    // Moves the last image out. The next decode() then allocates a new pixel buffer.
+    Image take_image();
+
+    // Headers and coefficients of the last decoded image, and the time spent decoding it when built with
+    // JPEG_DECODER_STATS.
+    const JPEGEncoded &encoded() const { return parsed; }
+    // Pool decoding restart intervals in parallel, see JPEGParser::set_thread_pool(), and rendering the
+    // pipelined decodings.
+    void set_thread_pool(ThreadPool *pool) noexcept;
+    // Whether to render the image on the pool while its scan is being entropy decoded, which lowers the latency
+    // of large images on an otherwise idle pool, at the cost of transforming a few more MCU rows. This applies to
+    // files whose single scan holds every component (the usual baseline files) when decoded without on_scan,
+    // other files being decoded as usual. Off by default.
+    void set_pipelined(bool pipelined) noexcept { this->pipelined = pipelined; }
+
+private:
+    PixelFormat format;
+    Upsampling upsampling;
+    Scale scale;
+    JPEGParser parser;
+    JPEGEncoded parsed;
+    std::optional<MCURowRenderer> renderer;
+    Image image;
+    ThreadPool *thread_pool = nullptr;
+    bool pipelined = false;
+
+    // Sets up the renderer and `image` for the frame of `parsed`. Returns the size of the rows of the image.
+    size_t prepare_image();
+    // Renders the coefficients of `parsed` into `image`.
+    void render_image();
+    // Parses and decodes the data of `parser`, rendering the MCU rows on the pool as soon as they are decoded.
+    void decode_pipelined(std::span<const unsigned char> data);
+};
+
+// Inverse transforms and color converts the coefficients of a parsed image.
+Image decode_image(const JPEGEncoded &encoded, PixelFormat format = PixelFormat::RGB,
+                   Upsampling upsampling = Upsampling::Fancy, Scale scale = Scale::Full);
+
+// Rectangle of the output image, in pixels (of the scaled image, when decoding at a smaller scale).
+struct Region {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// Decodes only the pixels of `region`, clipped to the image, e.g. a tile of a large image. Only the MCUs of
+// the region and the ones around it, which the upsampling reads, are inverse transformed and color converted.
+// Entropy decoding stops after the region, and with restart markers it also skips the intervals that do not
+// overlap the region, so the cost mostly depends on the size of the region rather than on the image's.
+// Files without restart markers need an `index` (built for the same file) to skip the rows above the region.
+Image decode_region(std::span<const unsigned char> data, Region region, PixelFormat format = PixelFormat::RGB,
+                    Upsampling upsampling = Upsampling::Fancy, Scale scale = Scale::Full,
+                    const ScanIndex *index = nullptr);
+
+// Consecutive rows of the output, as passed to a RowCallback.
+struct RowBand {
+    // Size of the whole image.
+    int width;
+    int height;
+    PixelFormat format;
+    // Rows [first_row, first_row + rows) of the image, starting at `pixels`, `row_size` bytes apart.
+    int first_row;
+    int rows;
+    const unsigned char *pixels;
+    size_t row_size;
+};
+
+// Called for each MCU row of the image, in order. The pixels are only valid during the call.
+using RowCallback = std::function<void(const RowBand &band)>;
+
+// Decodes a whole file without a frame buffer: each MCU row is entropy decoded, transformed and color converted
+// just in time to be passed to `callback`, so memory use only depends on the width of the image. This holds
+// for the usual files, whose single scan contains all the components. Files with several scans still need the
+// coefficients of the whole frame, but not a frame of pixels. A truncated file throws a JPEGError, after the
+// rows decoded from what it has (with missing data decoded as zero bits).
+void decode_rows(std::span<const unsigned char> data, const RowCallback &callback,
+                 PixelFormat format = PixelFormat::RGB, Upsampling upsampling = Upsampling::Fancy,
+                 Scale scale = Scale::Full);
+
+// Layout of the planes written by decode_planar(), which all have a full resolution Y plane and chroma halved in
+// both directions (rounded up), as video and GPU pipelines take them.
+enum class PlanarFormat {
+    // Y, Cb and Cr planes.
+    I420,
+    // Y plane, then a plane of interleaved Cb and Cr samples.
+    NV12,
+};
+
+// Rows of samples in memory owned by the caller (e.g. pinned or mapped device memory), `stride` bytes apart.
+// Only the stride can be checked: the memory must also hold the rows of the plane, that is at least
+// (rows - 1) * stride + row size bytes.
+struct Plane {
+    unsigned char *data;
+    size_t stride;
+};
+
+// Sizes of the planes, for an image of width by height pixels:
+// - y: height rows of width samples.
+// - cb and cr (I420): (height + 1) / 2 rows of (width + 1) / 2 samples.
+// - cb (NV12): (height + 1) / 2 rows of (width + 1) / 2 pairs of Cb and Cr samples.
+struct PlanarOutput {
+    PlanarFormat format;
+    Plane y;
+    // The interleaved plane for NV12, `cr` being unused.
+    Plane cb;
+    Plane cr;
+};
+
+// Decodes a whole file into the planes of `output`, sized as described by PlanarOutput for the size of the
+// image (see probe()). The samples are copied as the IDCT outputs them, without color conversion nor
+// upsampling. Files with other subsamplings than 4:2:0 have their chroma averaged or repeated to 4:2:0, and
+// grayscale files get neutral chroma. Memory use is that of decode_rows(). Throws std::runtime_error if the
+// components are not YCbCr or gray, the subsampling is not made of 2x ratios, or a stride is smaller than the
+// row of its plane.
+void decode_planar(std::span<const unsigned char> data, const PlanarOutput &output);
+
+#endif //UNTITLED_DECODER_H
@@ -0,0 +1,341 @@
+#include "file_loader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define HAS_IO_URING 1
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#else
+#define HAS_IO_URING 0
+#endif
+
+#if HAS_IO_URING
+
+// Submission and completion queues shared with the kernel, set up with the raw system calls (liburing being one
+// more dependency for a few lines).
+struct FileLoader::Ring {
+    int fd = -1;
+    void *queues = MAP_FAILED;
+    size_t queues_size = 0;
+    io_uring_sqe *sqes = (io_uring_sqe *) MAP_FAILED;
+    size_t sqes_size = 0;
+    // In the mapping of the queues. The kernel moves the heads of the submission queue and the tail of the
+    // completion queue, this side the other two.
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    io_uring_cqe *cqes;
+    // Tail of the submission queue including the entries not submitted yet.
+    unsigned local_tail;
+
+    // Null if io_uring is not available.
+    static std::unique_ptr<Ring> create(unsigned entries);
+    ~Ring();
+
+    // There must be room for it, i.e. no more entries queued or in flight than the size of the ring.
+    io_uring_sqe &next_entry() {
+        unsigned index = local_tail & sq_mask;
+        sq_array[index] = index;
+        local_tail += 1;
+        io_uring_sqe &entry = sqes[index];
+        std::memset(&entry, 0, sizeof(entry));
+        return entry;
+    }
+    // Submits the queued entries, and waits for `wait` completions. Throws std::runtime_error on failure.
+    void submit(unsigned wait);
+    // Calls `function` with each available completion, and removes it from the queue.
+    template<typename Function>
+    void complete(Function &&function) {
+        unsigned head = *cq_head;
+        while (head != std::atomic_ref(*cq_tail).load(std::memory_order_acquire)) {
+            io_uring_cqe completion = cqes[head & cq_mask];
+            head += 1;
+            std::atomic_ref(*cq_head).store(head, std::memory_order_release);
+            function(completion);
+        }
+    }
+};
+
+std::unique_ptr<FileLoader::Ring> FileLoader::Ring::create(unsigned entries) {
+    auto ring = std::make_unique<Ring>();
+    io_uring_params params {};
+    ring->fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    // Typically ENOSYS or EPERM, when the kernel is too old or io_uring is disabled (e.g. in containers).
+    if (ring->fd < 0 || !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        return nullptr;
+    }
+    // Both queues are in a single mapping, and the entries of the submission queue in another one.
+    ring->queues_size = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                                 params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    ring->queues = mmap(nullptr, ring->queues_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                        IORING_OFF_SQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    ring->sqes = (io_uring_sqe *) mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                       ring->fd, IORING_OFF_SQES);
+    if (ring->queues == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        return nullptr;
+    }
+    auto *base = (unsigned char *) ring->queues;
+    ring->sq_head = (unsigned *) (base + params.sq_off.head);
+    ring->sq_tail = (unsigned *) (base + params.sq_off.tail);
+    ring->sq_mask = *(unsigned *) (base + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) (base + params.sq_off.array);
+    ring->cq_head = (unsigned *) (base + params.cq_off.head);
+    ring->cq_tail = (unsigned *) (base + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *) (base + params.cq_off.ring_mask);
+    ring->cqes = (io_uring_cqe *) (base + params.cq_off.cqes);
+    ring->local_tail = *ring->sq_tail;
+    return ring;
+}
+
+FileLoader::Ring::~Ring() {
+    if (sqes != MAP_FAILED) {
+        munmap(sqes, sqes_size);
+    }
+    if (queues != MAP_FAILED) {
+        munmap(queues, queues_size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+void FileLoader::Ring::submit(unsigned wait) {
+    std::atomic_ref(*sq_tail).store(local_tail, std::memory_order_release);
+    while (true) {
+        // The kernel moves the head past the entries it consumed, even if the call is then interrupted.
+        unsigned pending = local_tail - std::atomic_ref(*sq_head).load(std::memory_order_acquire);
+        if (syscall(__NR_io_uring_enter, fd, pending, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0) >= 0) {
+            return;
+        }
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+        }
+    }
+}
+
+namespace {
+
+// A whole file, read a part at a time if the kernel returns less than asked.
+struct PendingRead {
+    LoadedFile file;
+    const std::string *path;
+    int fd;
+    size_t done;
+    iovec vector;
+};
+
+}
+
+void FileLoader::load_with_ring(std::span<const std::string> paths, const FileCallback &on_file) {
+    std::vector<PendingRead> reads(queue_depth);
+    std::vector<unsigned> free_slots;
+    for (unsigned slot = queue_depth; slot > 0; slot--) {
+        free_slots.push_back(slot - 1);
+    }
+    unsigned in_flight = 0;
+
+    auto queue_read = [&](unsigned slot) {
+        PendingRead &read = reads[slot];
+        read.vector = iovec {read.file.data.data() + read.done, read.file.data.size() - read.done};
+        io_uring_sqe &entry = ring->next_entry();
+        entry.opcode = IORING_OP_READV;
+        entry.fd = read.fd;
+        entry.addr = (unsigned long long) &read.vector;
+        entry.len = 1;
+        entry.off = read.done;
+        entry.user_data = slot;
+    };
+    auto finish_read = [&](unsigned slot) {
+        PendingRead &read = reads[slot];
+        close(read.fd);
+        in_flight -= 1;
+        free_slots.push_back(slot);
+        LoadedFile file = std::move(read.file);
+        on_file(file);
+    };
+    auto fail = [&](LoadedFile &file, const char *message, const std::string &path) {
+        file.data.clear();
+        file.error = std::make_exception_ptr(std::runtime_error(message + path));
+    };
+
+    size_t next = 0;
+    try {
+        while (next < paths.size() || in_flight > 0) {
+            while (!free_slots.empty() && next < paths.size()) {
+                LoadedFile file {next, {}, nullptr};
+                const std::string &path = paths[next++];
+                int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                struct stat file_stat {};
+                if (fd < 0 || fstat(fd, &file_stat) != 0) {
+                    if (fd >= 0) {
+                        close(fd);
+                    }
+                    fail(file, "Cannot open ", path);
+                    on_file(file);
+                    continue;
+                }
+                if (file_stat.st_size == 0) {
+                    close(fd);
+                    on_file(file);
+                    continue;
+                }
+                file.data.resize((size_t) file_stat.st_size);
+                unsigned slot = free_slots.back();
+                free_slots.pop_back();
+                reads[slot] = PendingRead {std::move(file), &path, fd, 0, {}};
+                in_flight += 1;
+                queue_read(slot);
+            }
+            if (in_flight == 0) {
+                continue;
+            }
+
+            ring->submit(1);
+            ring->complete([&](const io_uring_cqe &completion) {
+                auto slot = (unsigned) completion.user_data;
+                PendingRead &read = reads[slot];
+                if (completion.res == -EINTR || completion.res == -EAGAIN) {
+                    queue_read(slot);
+                } else if (completion.res < 0) {
+                    fail(read.file, "Cannot read ", *read.path);
+                    finish_read(slot);
+                } else if (completion.res == 0) {
+                    // The file got shorter since it was opened.
+                    read.file.data.resize(read.done);
+                    finish_read(slot);
+                } else {
+                    read.done += completion.res;
+                    if (read.done < read.file.data.size()) {
+                        queue_read(slot);
+                    } else {
+                        finish_read(slot);
+                    }
+                }
+            });
+        }
+    } catch (...) {
+        // The kernel may still write to the buffers of the reads in flight, which must complete before they
+        // are freed.
+        while (in_flight > 0) {
+            try {
+                ring->submit(1);
+            } catch (...) {
+                // Nothing else to do than hoping they completed, the ring is broken.
+                std::terminate();
+            }
+            ring->complete([&](const io_uring_cqe &completion) {
+                auto slot = (unsigned) completion.user_data;
+                close(reads[slot].fd);
+                in_flight -= 1;
+            });
+        }
+        throw;
+    }
+}
+
+#else
+
+struct FileLoader::Ring {};
+
+void FileLoader::load_with_ring(std::span<const std::string> paths, const FileCallback &on_file) {
+    load_with_threads(paths, on_file);
+}
+
+#endif
+
+FileLoader::FileLoader(unsigned queue_depth): queue_depth(std::max(queue_depth, 1u)) {
+#if HAS_IO_URING
+    ring = Ring::create(this->queue_depth);
+#endif
+}
+
+FileLoader::~FileLoader() = default;
+
+void FileLoader::load(std::span<const std::string> paths, const FileCallback &on_file) {
+    if (ring) {
+        load_with_ring(paths, on_file);
+    } else {
+        load_with_threads(paths, on_file);
+    }
+}
+
+static LoadedFile read_file(size_t index, const std::string &path) {
+    LoadedFile file {index, {}, nullptr};
+    std::ifstream input(path, std::ios::binary | std::ios::ate);
+    std::streamsize size = input.tellg();
+    if (!input || size < 0) {
+        file.error = std::make_exception_ptr(std::runtime_error("Cannot open " + path));
+        return file;
+    }
+    file.data.resize((size_t) size);
+    input.seekg(0);
+    if (!input.read((char *) file.data.data(), size)) {
+        file.data.clear();
+        file.error = std::make_exception_ptr(std::runtime_error("Cannot read " + path));
+    }
+    return file;
+}
+
+void FileLoader::load_with_threads(std::span<const std::string> paths, const FileCallback &on_file) {
+    std::mutex mutex;
+    std::condition_variable read;
+    std::deque<LoadedFile> files;
+    std::atomic<size_t> next {0};
+
+    // Blocking reads, as many in flight as there are threads.
+    unsigned threads = (unsigned) std::min<size_t>({queue_depth, 16, paths.size()});
+    std::vector<std::thread> readers;
+    for (unsigned i = 0; i < threads; i++) {
+        readers.emplace_back([&] {
+            size_t index;
+            while ((index = next++) < paths.size()) {
+                LoadedFile file = read_file(index, paths[index]);
+                std::lock_guard lock {mutex};
+                files.push_back(std::move(file));
+                read.notify_one();
+            }
+        });
+    }
+
+    std::exception_ptr error;
+    for (size_t delivered = 0; delivered < paths.size() && !error; delivered++) {
+        std::unique_lock lock {mutex};
+        read.wait(lock, [&] { return !files.empty(); });
+        LoadedFile file = std::move(files.front());
+        files.pop_front();
+        lock.unlock();
+        try {
+            on_file(file);
+        } catch (...) {
+            // The files not taken yet are skipped.
+            error = std::current_exception();
+            next = paths.size();
+        }
+    }
+    for (std::thread &reader: readers) {
+        reader.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
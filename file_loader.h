@@ -0,0 +1,54 @@
+#ifndef UNTITLED_FILE_LOADER_H
+#define UNTITLED_FILE_LOADER_H
+
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+// Contents of a file read by a FileLoader.
+struct LoadedFile {
+    // Index of the file in the paths passed to FileLoader::load().
+    size_t index;
+    std::vector<unsigned char> data;
+    // Set (and `data` left empty) if the file could not be read.
+    std::exception_ptr error;
+};
+
+// Reads many files into memory with up to `queue_depth` reads in flight, so that storage is kept busy rather
+// than waited on one file at a time. On Linux, the reads go through an io_uring from the calling thread. Where
+// it is not available (other systems, old kernels, or a kernel forbidding it), they are blocking reads run by
+// threads of the loader's own, one per read in flight (up to 16).
+//
+//     FileLoader loader;
+//     loader.load(paths, [](LoadedFile &file) { ... });
+class FileLoader {
+public:
+    explicit FileLoader(unsigned queue_depth = 64);
+    ~FileLoader();
+    FileLoader(const FileLoader &) = delete;
+    FileLoader &operator=(const FileLoader &) = delete;
+
+    // Called on the thread calling load(), which stops reading during the call, so it should be short (e.g.
+    // handing the data to another thread). The data can be moved out.
+    using FileCallback = std::function<void(LoadedFile &file)>;
+    // Reads every file, calling `on_file` for each as soon as it is read, in the order the reads complete.
+    // Errors are passed to `on_file` as well, so this only throws if `on_file` does.
+    void load(std::span<const std::string> paths, const FileCallback &on_file);
+
+    bool uses_io_uring() const noexcept { return ring != nullptr; }
+
+private:
+    unsigned queue_depth;
+    // Only if io_uring could be set up.
+    struct Ring;
+    std::unique_ptr<Ring> ring;
+
+    void load_with_ring(std::span<const std::string> paths, const FileCallback &on_file);
+    void load_with_threads(std::span<const std::string> paths, const FileCallback &on_file);
+};
+
+#endif //UNTITLED_FILE_LOADER_H
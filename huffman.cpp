@@ -0,0 +1,200 @@
+#include "huffman.h"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+bool HuffmanTable::valid_size_data(const std::array<unsigned char, 16> &size_data) {
+    // The codes of each length follow the (shifted) shorter ones, and must all fit in that length.
+    unsigned int code = 0;
+    for (int length = 1; length <= 16; length++) {
+        code += size_data[length - 1];
+        if (code > (1u << length)) {
+            return false;
+        }
+        code <<= 1;
+    }
+    return true;
+}
+
+HuffmanTable HuffmanTable::from_size_data(const std::array<unsigned char, 16> &size_data, std::span<const unsigned char> data_area) {
+    if (!valid_size_data(size_data)) {
+        throw std::runtime_error("Invalid Huffman table");
+    }
+    HuffmanTable table {};
+    // Canonical Huffman codes: consecutive values for a given length, then a shift when the length increases.
+    unsigned short code = 0;
+    int index = 0;
+    int count = (int) std::min<size_t>(data_area.size(), table.codes.size());
+    for (int length = 1; length <= 16; length++) {
+        for (int j = 0; j < size_data[length - 1] && index < count; j++) {
+            table.codes[index] = HuffmanCode {(unsigned char) length, code, data_area[index]};
+            code += 1;
+            index += 1;
+        }
+        code <<= 1;
+    }
+    table.codes_nbr = (unsigned short) index;
+    return table;
+}
+
+HuffmanTable HuffmanTable::from_frequencies(const std::array<unsigned long long, 256> &frequencies) {
+    // Symbol 256 is reserved with the lowest frequency, so that it gets the code made of ones only, which is
+    // then dropped.
+    std::array<unsigned long long, 257> frequency {};
+    std::copy(frequencies.begin(), frequencies.end(), frequency.begin());
+    frequency[256] = 1;
+    std::array<int, 257> code_size {};
+    // Next symbol in the chain of symbols merged into the same tree node, -1 at the end of the chain.
+    std::array<int, 257> others {};
+    others.fill(-1);
+
+    while (true) {
+        // The two least frequent nodes, the one with the highest value first in case of a tie.
+        int first = -1;
+        int second = -1;
+        for (int i = 0; i < 257; i++) {
+            if (frequency[i] == 0) {
+                continue;
+            }
+            if (first < 0 || frequency[i] <= frequency[first]) {
+                second = first;
+                first = i;
+            } else if (second < 0 || frequency[i] <= frequency[second]) {
+                second = i;
+            }
+        }
+        if (second < 0) {
+            break;
+        }
+        // Merges the second node into the first one, every symbol of both getting one more bit.
+        frequency[first] += frequency[second];
+        frequency[second] = 0;
+        code_size[first] += 1;
+        while (others[first] >= 0) {
+            first = others[first];
+            code_size[first] += 1;
+        }
+        others[first] = second;
+        code_size[second] += 1;
+        while (others[second] >= 0) {
+            second = others[second];
+            code_size[second] += 1;
+        }
+    }
+
+    // Codes can be up to 256 bits long for pathological frequencies, they are brought back to 16 bits by
+    // moving pairs of the longest codes up the tree (K.3).
+    std::array<int, 258> counts {};
+    for (int i = 0; i < 257; i++) {
+        counts[code_size[i]] += 1;
+    }
+    for (int length = 257; length > 16; length--) {
+        while (counts[length] > 0) {
+            int shorter = length - 2;
+            while (counts[shorter] == 0) {
+                shorter -= 1;
+            }
+            counts[length] -= 2;
+            counts[length - 1] += 1;
+            counts[shorter + 1] += 2;
+            counts[shorter] -= 1;
+        }
+    }
+    // Removes the reserved code, which is one of the longest.
+    int longest = 16;
+    while (counts[longest] == 0) {
+        longest -= 1;
+    }
+    counts[longest] -= 1;
+
+    // Values by increasing code size, which is all the canonical codes depend on.
+    std::array<unsigned char, 16> size_data {};
+    std::array<unsigned char, 256> data_area {};
+    int values_nbr = 0;
+    for (int length = 1; length <= 16; length++) {
+        size_data[length - 1] = (unsigned char) counts[length];
+    }
+    for (int length = 1; length < 258; length++) {
+        for (int i = 0; i < 256; i++) {
+            if (code_size[i] == length) {
+                data_area[values_nbr++] = (unsigned char) i;
+            }
+        }
+    }
+    return from_size_data(size_data, std::span<const unsigned char>(data_area.data(), values_nbr));
+}
+
+
+HuffmanDecoder HuffmanDecoder::from_table(const HuffmanTable &table) {
+    HuffmanDecoder decoder {};
+
+    // Canonical codes of a given length are consecutive, so each length is fully described by its first
+    // code and the index of that code in the (length-sorted) value list.
+    std::array<int, 17> first_code {};
+    std::array<int, 17> first_index {};
+    std::array<int, 17> count {};
+    for (int i = 0; i < table.codes_nbr; i++) {
+        const HuffmanCode &code = table.codes[i];
+        if (count[code.length] == 0) {
+            first_code[code.length] = code.code;
+            first_index[code.length] = i;
+        }
+        count[code.length] += 1;
+        decoder.values[i] = code.value;
+    }
+
+    for (int length = 1; length <= 16; length++) {
+        decoder.delta[length] = first_index[length] - first_code[length];
+        decoder.maxcode[length] = (unsigned int) (first_code[length] + count[length]) << (16 - length);
+    }
+    decoder.maxcode[17] = 0xffffffff;
+
+    for (int i = 0; i < table.codes_nbr; i++) {
+        const HuffmanCode &code = table.codes[i];
+        if (code.length > HUFFMAN_FAST_BITS) {
+            continue;
+        }
+        assert(code.code < (1 << code.length));
+        // Every index starting with this code resolves to it, whatever the remaining bits are.
+        int shift = HUFFMAN_FAST_BITS - code.length;
+        for (int suffix = 0; suffix < (1 << shift); suffix++) {
+            decoder.fast[(code.code << shift) | suffix] = (unsigned short) ((code.length << 8) | code.value);
+        }
+    }
+
+    for (int i = 0; i < (1 << HUFFMAN_FAST_BITS); i++) {
+        unsigned short entry = decoder.fast[i];
+        if (entry == 0) {
+            continue;
+        }
+        unsigned char value = entry & 0xff;
+        int length = entry >> 8;
+        int run = value >> 4;
+        int magnitude_size = value & 0x0f;
+        if (magnitude_size == 0 || length + magnitude_size > HUFFMAN_FAST_BITS) {
+            continue;
+        }
+        unsigned int magnitude = (i >> (HUFFMAN_FAST_BITS - length - magnitude_size)) & ((1 << magnitude_size) - 1);
+        int coefficient = extend_magnitude(magnitude, magnitude_size);
+        // The coefficient has to fit in the 8 high bits of the entry.
+        if (coefficient >= -128 && coefficient <= 127) {
+            decoder.fast_ac[i] = (short) (coefficient * 256 + (run << 4) + length + magnitude_size);
+        }
+    }
+
+    return decoder;
+}
+
+HuffmanSymbol HuffmanDecoder::decode_slow(unsigned int bits16) const {
+    int length = HUFFMAN_FAST_BITS + 1;
+    // Bounded for the decoders of tables never defined, whose sentinel is not set either.
+    while (length <= 16 && bits16 >= maxcode[length]) {
+        length += 1;
+    }
+    if (length > 16) {
+        return HuffmanSymbol {0, 0};
+    }
+    int index = (int) (bits16 >> (16 - length)) + delta[length];
+    return HuffmanSymbol {values[index], (unsigned char) length};
+}
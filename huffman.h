@@ -0,0 +1,77 @@
+#ifndef UNTITLED_HUFFMAN_H
+#define UNTITLED_HUFFMAN_H
+
+#include <array>
+#include <span>
+
+struct HuffmanCode {
+    unsigned char length;
+    unsigned short code;
+    // The value the code is mapped to.
+    unsigned char value;
+};
+
+
+struct HuffmanTable {
+    // Codes sorted by code length. Only the first codes_nbr ones are meaningful.
+    std::array<HuffmanCode, 256> codes;
+    unsigned short codes_nbr;
+
+    // Whether `size_data` (the number of codes of each length) describes codes that fit in their lengths. Tables
+    // with more codes than that would map codes longer than 16 bits.
+    static bool valid_size_data(const std::array<unsigned char, 16> &size_data);
+    // `size_data` holds the number of codes of each length (1 to 16 bits), `data_area` the values mapped to
+    // them by increasing length. Values past the 256th are ignored. Throws std::runtime_error if `size_data`
+    // is not valid.
+    static HuffmanTable from_size_data(const std::array<unsigned char, 16> &size_data, std::span<const unsigned char> data_area);
+    // Optimal table for values occurring `frequencies` times, with codes of at most 16 bits and none made of
+    // ones only (K.2 of the spec). Values that never occur get no code.
+    static HuffmanTable from_frequencies(const std::array<unsigned long long, 256> &frequencies);
+};
+
+
+// Number of bits resolved by the first-level lookup table. Codes up to this length (which are the vast
+// majority of the codes emitted by real encoders) are decoded with a single table probe.
+constexpr int HUFFMAN_FAST_BITS = 9;
+
+struct HuffmanSymbol {
+    unsigned char value;
+    // Length of the code in bits, 0 if the bits do not start with a valid code.
+    unsigned char length;
+};
+
+// Table-driven decoder for a canonical Huffman table.
+// All lookups take the next 16 bits of the entropy-coded stream, MSB first, and never consume anything
+// themselves: the caller is responsible for skipping `length` bits afterwards.
+struct HuffmanDecoder {
+    // Indexed by the next HUFFMAN_FAST_BITS bits: (length << 8) | value, 0 if the code is longer.
+    std::array<unsigned short, 1 << HUFFMAN_FAST_BITS> fast;
+    // AC-specific fused table, indexed like `fast`. When both the code and the magnitude bits following it
+    // fit in HUFFMAN_FAST_BITS, holds (coefficient << 8) | (run << 4) | total length, and 0 otherwise.
+    std::array<short, 1 << HUFFMAN_FAST_BITS> fast_ac;
+    // maxcode[l] is one past the last code of length l, left-aligned on 16 bits. maxcode[17] is a sentinel.
+    std::array<unsigned int, 18> maxcode;
+    // Maps a code of length l to its index in `values`.
+    std::array<int, 17> delta;
+    std::array<unsigned char, 256> values;
+
+    static HuffmanDecoder from_table(const HuffmanTable &table);
+
+    HuffmanSymbol decode(unsigned int bits16) const {
+        unsigned short entry = fast[bits16 >> (16 - HUFFMAN_FAST_BITS)];
+        if (entry != 0) {
+            return HuffmanSymbol {(unsigned char) (entry & 0xff), (unsigned char) (entry >> 8)};
+        }
+        return decode_slow(bits16);
+    }
+
+private:
+    HuffmanSymbol decode_slow(unsigned int bits16) const;
+};
+
+// Sign-extends the `size` magnitude bits that follow a Huffman-coded category (F.2.2.1 of the spec).
+inline int extend_magnitude(unsigned int bits, int size) {
+    return bits < (1u << (size - 1)) ? (int) bits - (1 << size) + 1 : (int) bits;
+}
+
+#endif //UNTITLED_HUFFMAN_H
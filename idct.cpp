@@ -0,0 +1,220 @@
+#include "idct.h"
+
+#include <algorithm>
+
+#include "cpu_features.h"
+#include "idct_kernel.h"
+
+namespace {
+
+// A single lane: the scalar IDCT processes one column (then one row) at a time.
+struct ScalarOps {
+    using Vector = int;
+
+    static int set(int value) { return value; }
+    static int add(int a, int b) { return a + b; }
+    static int sub(int a, int b) { return a - b; }
+    static int mul(int a, int constant) { return a * constant; }
+    static int shl(int a, int count) { return a << count; }
+    static int sra(int a, int count) { return a >> count; }
+};
+
+}
+
+void idct_scalar(const short *coefficients, const short *multipliers, unsigned char *output, int stride) {
+    int workspace[64];
+
+    for (int column = 0; column < 8; column++) {
+        int x[8];
+        bool ac_zero = true;
+        for (int k = 0; k < 8; k++) {
+            x[k] = coefficients[k * 8 + column] * multipliers[k * 8 + column];
+            ac_zero = ac_zero && (k == 0 || x[k] == 0);
+        }
+        // Columns with no AC coefficient are common, and their output is simply the scaled DC.
+        if (ac_zero) {
+            for (int k = 0; k < 8; k++) {
+                workspace[k * 8 + column] = x[0] << IDCT_PASS1_BITS;
+            }
+            continue;
+        }
+        idct_1d<ScalarOps>(x, IDCT_PASS1_SHIFT, IDCT_PASS1_BIAS);
+        for (int k = 0; k < 8; k++) {
+            workspace[k * 8 + column] = x[k];
+        }
+    }
+
+    for (int row = 0; row < 8; row++) {
+        int x[8];
+        std::copy_n(workspace + row * 8, 8, x);
+        idct_1d<ScalarOps>(x, IDCT_PASS2_SHIFT, IDCT_PASS2_BIAS);
+        for (int k = 0; k < 8; k++) {
+            output[row * stride + k] = (unsigned char) std::clamp(x[k], 0, 255);
+        }
+    }
+}
+
+namespace {
+
+int descale(int x, int shift) {
+    return (x + (1 << (shift - 1))) >> shift;
+}
+
+unsigned char clamp_sample(int x) {
+    return (unsigned char) std::clamp(x + 128, 0, 255);
+}
+
+}
+
+void idct_4x4_scalar(const short *coefficients, const short *multipliers, unsigned char *output, int stride) {
+    // Both passes are written over all their columns (resp. rows) at once, which compilers vectorize well.
+    // Input row 4 has no contribution to 4-point outputs.
+    int x[8][8];
+    for (int k = 0; k < 64; k++) {
+        x[k / 8][k % 8] = coefficients[k] * multipliers[k];
+    }
+
+    // Transposed, so that the second pass also works on contiguous values.
+    int workspace[8][4];
+    for (int column = 0; column < 8; column++) {
+        int tmp0 = x[0][column] * (1 << (IDCT_CONST_BITS + 1));
+        int tmp2 = x[2][column] * FIX_1_847759065 - x[6][column] * FIX_0_765366865;
+        int tmp10 = tmp0 + tmp2;
+        int tmp12 = tmp0 - tmp2;
+        int odd0 = -x[7][column] * FIX_0_211164243 + x[5][column] * FIX_1_451774981 -
+                   x[3][column] * FIX_2_172734803 + x[1][column] * FIX_1_061594337;
+        int odd2 = -x[7][column] * FIX_0_509795579 - x[5][column] * FIX_0_601344887 +
+                   x[3][column] * FIX_0_899976223 + x[1][column] * FIX_2_562915447;
+        constexpr int shift = IDCT4_PASS1_SHIFT;
+        workspace[column][0] = descale(tmp10 + odd2, shift);
+        workspace[column][3] = descale(tmp10 - odd2, shift);
+        workspace[column][1] = descale(tmp12 + odd0, shift);
+        workspace[column][2] = descale(tmp12 - odd0, shift);
+    }
+
+    int out[4][4];
+    for (int row = 0; row < 4; row++) {
+        int tmp0 = workspace[0][row] * (1 << (IDCT_CONST_BITS + 1));
+        int tmp2 = workspace[2][row] * FIX_1_847759065 - workspace[6][row] * FIX_0_765366865;
+        int tmp10 = tmp0 + tmp2;
+        int tmp12 = tmp0 - tmp2;
+        int odd0 = -workspace[7][row] * FIX_0_211164243 + workspace[5][row] * FIX_1_451774981 -
+                   workspace[3][row] * FIX_2_172734803 + workspace[1][row] * FIX_1_061594337;
+        int odd2 = -workspace[7][row] * FIX_0_509795579 - workspace[5][row] * FIX_0_601344887 +
+                   workspace[3][row] * FIX_0_899976223 + workspace[1][row] * FIX_2_562915447;
+        constexpr int shift = IDCT4_PASS2_SHIFT;
+        out[0][row] = descale(tmp10 + odd2, shift);
+        out[3][row] = descale(tmp10 - odd2, shift);
+        out[1][row] = descale(tmp12 + odd0, shift);
+        out[2][row] = descale(tmp12 - odd0, shift);
+    }
+    for (int row = 0; row < 4; row++) {
+        for (int k = 0; k < 4; k++) {
+            output[row * stride + k] = clamp_sample(out[k][row]);
+        }
+    }
+}
+
+void idct_2x2_scalar(const short *coefficients, const short *multipliers, unsigned char *output, int stride) {
+    // Only input rows (then columns) 0, 1, 3, 5 and 7 contribute.
+    int workspace[2][8];
+    for (int column = 0; column < 8; column += column == 0 ? 1 : 2) {
+        int x[8];
+        bool ac_zero = true;
+        for (int k = 0; k < 8; k++) {
+            x[k] = coefficients[k * 8 + column] * multipliers[k * 8 + column];
+            ac_zero = ac_zero && (k % 2 == 0 || x[k] == 0);
+        }
+        if (ac_zero) {
+            workspace[0][column] = x[0] << IDCT_PASS1_BITS;
+            workspace[1][column] = x[0] << IDCT_PASS1_BITS;
+            continue;
+        }
+        int tmp10 = x[0] * (1 << (IDCT_CONST_BITS + 2));
+        int tmp0 = -x[7] * FIX_0_720959822 + x[5] * FIX_0_850430095 - x[3] * FIX_1_272758580 + x[1] * FIX_3_624509785;
+        workspace[0][column] = descale(tmp10 + tmp0, IDCT2_PASS1_SHIFT);
+        workspace[1][column] = descale(tmp10 - tmp0, IDCT2_PASS1_SHIFT);
+    }
+
+    for (int row = 0; row < 2; row++) {
+        const int *x = workspace[row];
+        int tmp10 = x[0] * (1 << (IDCT_CONST_BITS + 2));
+        int tmp0 = -x[7] * FIX_0_720959822 + x[5] * FIX_0_850430095 - x[3] * FIX_1_272758580 + x[1] * FIX_3_624509785;
+        output[row * stride] = clamp_sample(descale(tmp10 + tmp0, IDCT2_PASS2_SHIFT));
+        output[row * stride + 1] = clamp_sample(descale(tmp10 - tmp0, IDCT2_PASS2_SHIFT));
+    }
+}
+
+void idct_1x1_scalar(const short *coefficients, const short *multipliers, unsigned char *output, int) {
+    // The average of the block is its DC divided by 8.
+    output[0] = clamp_sample(descale(coefficients[0] * multipliers[0], 3));
+}
+
+
+static IDCTFunction select_idct() {
+    const CpuFeatures &features = cpu_features();
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    if (features.avx2) {
+        return idct_avx2;
+    }
+    if (features.sse2) {
+        return idct_sse2;
+    }
+#endif
+#if defined(__ARM_NEON) || defined(__aarch64__)
+    if (features.neon) {
+        return idct_neon;
+    }
+#endif
+    (void) features;
+    return idct_scalar;
+}
+
+static IDCTFunction select_reduced_idct(int block_size) {
+    const CpuFeatures &features = cpu_features();
+    bool size4 = block_size == 4;
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    if (features.avx2) {
+        return size4 ? idct_4x4_avx2 : idct_2x2_avx2;
+    }
+    if (features.sse2) {
+        return size4 ? idct_4x4_sse2 : idct_2x2_sse2;
+    }
+#endif
+#if defined(__ARM_NEON) || defined(__aarch64__)
+    if (features.neon) {
+        return size4 ? idct_4x4_neon : idct_2x2_neon;
+    }
+#endif
+    (void) features;
+    return size4 ? idct_4x4_scalar : idct_2x2_scalar;
+}
+
+IDCTFunction idct_function() {
+    static const IDCTFunction function = select_idct();
+    return function;
+}
+
+
+IDCTFunction idct_function(int block_size) {
+    static const IDCTFunction idct_4x4 = select_reduced_idct(4);
+    static const IDCTFunction idct_2x2 = select_reduced_idct(2);
+    switch (block_size) {
+        case 1:
+            return idct_1x1_scalar;
+        case 2:
+            return idct_2x2;
+        case 4:
+            return idct_4x4;
+        default:
+            return idct_function();
+    }
+}
+
+void inverse_transform_block_row(const ComponentCoefficients &coefficients, int block_row,
+                                 const QuantizationTable &table, unsigned char *output, int stride, int block_size) {
+    IDCTFunction idct = idct_function(block_size);
+    for (int bx = 0; bx < coefficients.blocks_x; bx++) {
+        idct(coefficients.block(bx, block_row), table.idct_multipliers.data(), output + bx * block_size, stride);
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef UNTITLED_IDCT_H
+#define UNTITLED_IDCT_H
+
+#include "jpeg_parser.h"
+
+// Dequantizes and inverse transforms one block of coefficients (natural order) into 8x8 samples.
+// `multipliers` are QuantizationTable::idct_multipliers, so that dequantization happens in the same pass as
+// the first (column) pass of the IDCT. All the implementations use the same fixed-point algorithm (the
+// Loeffler-Ligtenberg-Moschytz one used by libjpeg's "islow" IDCT) and give identical results.
+// Both `coefficients` and `multipliers` must be 16-byte aligned, as ComponentCoefficients and QuantizationTable are.
+using IDCTFunction = void (*)(const short *coefficients, const short *multipliers, unsigned char *output, int stride);
+
+void idct_scalar(const short *coefficients, const short *multipliers, unsigned char *output, int stride);
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+void idct_sse2(const short *coefficients, const short *multipliers, unsigned char *output, int stride);
+void idct_avx2(const short *coefficients, const short *multipliers, unsigned char *output, int stride);
+#endif
+#if defined(__ARM_NEON) || defined(__aarch64__)
+void idct_neon(const short *coefficients, const short *multipliers, unsigned char *output, int stride);
+#endif
+
+// Reduced IDCTs, which output the 4x4, 2x2 or 1x1 samples of a block scaled down by 2, 4 or 8. As the high
+// frequencies are ignored rather than filtered, this is both much faster and better looking than downscaling
+// the full 8x8 output. Those are libjpeg's "jidctred" algorithms.
+void idct_4x4_scalar(const short *coefficients, const short *multipliers, unsigned char *output, int stride);
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+void idct_4x4_sse2(const short *coefficients, const short *multipliers, unsigned char *output, int stride);
+void idct_2x2_sse2(const short *coefficients, const short *multipliers, unsigned char *output, int stride);
+void idct_4x4_avx2(const short *coefficients, const short *multipliers, unsigned char *output, int stride);
+void idct_2x2_avx2(const short *coefficients, const short *multipliers, unsigned char *output, int stride);
+#endif
+#if defined(__ARM_NEON) || defined(__aarch64__)
+void idct_4x4_neon(const short *coefficients, const short *multipliers, unsigned char *output, int stride);
+void idct_2x2_neon(const short *coefficients, const short *multipliers, unsigned char *output, int stride);
+#endif
+void idct_2x2_scalar(const short *coefficients, const short *multipliers, unsigned char *output, int stride);
+// DC only: the average of the block samples.
+void idct_1x1_scalar(const short *coefficients, const short *multipliers, unsigned char *output, int stride);
+
+// The fastest implementation supported by the CPU we are running on.
+IDCTFunction idct_function();
+// The IDCT outputting `block_size` (8, 4, 2 or 1) samples per block side.
+IDCTFunction idct_function(int block_size);
+
+// Inverse transforms a row of blocks of `coefficients` into `block_size` rows of `output`, `stride` bytes apart,
+// each block giving `block_size` x `block_size` samples.
+void inverse_transform_block_row(const ComponentCoefficients &coefficients, int block_row,
+                                 const QuantizationTable &table, unsigned char *output, int stride,
+                                 int block_size = 8);
+
+#endif //UNTITLED_IDCT_H
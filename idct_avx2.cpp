@@ -0,0 +1,77 @@
+#include "idct.h"
+
+// Built with AVX2 enabled (see CMakeLists.txt), only called when the CPU supports it.
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+
+#include <immintrin.h>
+
+#include "idct_kernel.h"
+
+namespace {
+
+struct AVX2Ops {
+    using Vector = __m256i;
+
+    static Vector set(int value) { return _mm256_set1_epi32(value); }
+    static Vector add(Vector a, Vector b) { return _mm256_add_epi32(a, b); }
+    static Vector sub(Vector a, Vector b) { return _mm256_sub_epi32(a, b); }
+    static Vector mul(Vector a, int constant) { return _mm256_mullo_epi32(a, _mm256_set1_epi32(constant)); }
+    static Vector shl(Vector a, int count) { return _mm256_sll_epi32(a, _mm_cvtsi32_si128(count)); }
+    static Vector sra(Vector a, int count) { return _mm256_sra_epi32(a, _mm_cvtsi32_si128(count)); }
+
+    static Vector load_dequantize(const short *coefficients, const short *multipliers) {
+        __m256i c = _mm256_cvtepi16_epi32(_mm_load_si128((const __m128i *) coefficients));
+        __m256i m = _mm256_cvtepi16_epi32(_mm_load_si128((const __m128i *) multipliers));
+        return _mm256_mullo_epi32(c, m);
+    }
+
+    static void store_samples(Vector a, unsigned char *output) {
+        __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+        _mm_storel_epi64((__m128i *) output, _mm_packus_epi16(words, words));
+    }
+
+    static void transpose(Vector (&x)[8]) {
+        __m256i t0 = _mm256_unpacklo_epi32(x[0], x[1]);
+        __m256i t1 = _mm256_unpackhi_epi32(x[0], x[1]);
+        __m256i t2 = _mm256_unpacklo_epi32(x[2], x[3]);
+        __m256i t3 = _mm256_unpackhi_epi32(x[2], x[3]);
+        __m256i t4 = _mm256_unpacklo_epi32(x[4], x[5]);
+        __m256i t5 = _mm256_unpackhi_epi32(x[4], x[5]);
+        __m256i t6 = _mm256_unpacklo_epi32(x[6], x[7]);
+        __m256i t7 = _mm256_unpackhi_epi32(x[6], x[7]);
+
+        __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+        __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+        __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+        __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+        __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+        __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+        __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+        __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+        x[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+        x[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+        x[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+        x[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+        x[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+        x[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+        x[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+        x[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+    }
+};
+
+}
+
+void idct_avx2(const short *coefficients, const short *multipliers, unsigned char *output, int stride) {
+    idct_8x8<AVX2Ops>(coefficients, multipliers, output, stride);
+}
+
+void idct_4x4_avx2(const short *coefficients, const short *multipliers, unsigned char *output, int stride) {
+    idct_4x4<AVX2Ops>(coefficients, multipliers, output, stride);
+}
+
+void idct_2x2_avx2(const short *coefficients, const short *multipliers, unsigned char *output, int stride) {
+    idct_2x2<AVX2Ops>(coefficients, multipliers, output, stride);
+}
+
+#endif
@@ -0,0 +1,202 @@
+#ifndef UNTITLED_IDCT_KERNEL_H
+#define UNTITLED_IDCT_KERNEL_H
+
+#include <cstring>
+
+// Fixed-point constants of the LLM IDCT, scaled by 2^IDCT_CONST_BITS.
+constexpr int IDCT_CONST_BITS = 13;
+// Extra precision kept between the two passes.
+constexpr int IDCT_PASS1_BITS = 2;
+
+constexpr int FIX_0_298631336 = 2446;
+constexpr int FIX_0_390180644 = 3196;
+constexpr int FIX_0_541196100 = 4433;
+constexpr int FIX_0_765366865 = 6270;
+constexpr int FIX_0_899976223 = 7373;
+constexpr int FIX_1_175875602 = 9633;
+constexpr int FIX_1_501321110 = 12299;
+constexpr int FIX_1_847759065 = 15137;
+constexpr int FIX_1_961570560 = 16069;
+constexpr int FIX_2_053119869 = 16819;
+constexpr int FIX_2_562915447 = 20995;
+constexpr int FIX_3_072711026 = 25172;
+
+// Constants of the reduced 4x4 and 2x2 IDCTs (libjpeg's jidctred.c).
+constexpr int FIX_0_211164243 = 1730;
+constexpr int FIX_0_509795579 = 4176;
+constexpr int FIX_0_601344887 = 4926;
+constexpr int FIX_0_720959822 = 5906;
+constexpr int FIX_0_850430095 = 6967;
+constexpr int FIX_1_061594337 = 8697;
+constexpr int FIX_1_272758580 = 10426;
+constexpr int FIX_1_451774981 = 11893;
+constexpr int FIX_2_172734803 = 17799;
+constexpr int FIX_3_624509785 = 29692;
+
+// Shift and rounding bias of both passes. The second one also level-shifts the samples by 128.
+constexpr int IDCT_PASS1_SHIFT = IDCT_CONST_BITS - IDCT_PASS1_BITS;
+constexpr int IDCT_PASS1_BIAS = 1 << (IDCT_PASS1_SHIFT - 1);
+constexpr int IDCT_PASS2_SHIFT = IDCT_CONST_BITS + IDCT_PASS1_BITS + 3;
+constexpr int IDCT_PASS2_BIAS = (1 << (IDCT_PASS2_SHIFT - 1)) + (128 << IDCT_PASS2_SHIFT);
+
+// One dimensional IDCT of 8 vectors, computed independently in each lane. `Ops` provides the vector type
+// and its arithmetic, so that every SIMD flavour shares this exact code (see idct_sse2.cpp and friends).
+template <class Ops>
+inline void idct_1d(typename Ops::Vector (&x)[8], int shift, int bias) {
+    using V = typename Ops::Vector;
+
+    // Even part
+    V z1 = Ops::mul(Ops::add(x[2], x[6]), FIX_0_541196100);
+    V tmp2 = Ops::add(z1, Ops::mul(x[6], -FIX_1_847759065));
+    V tmp3 = Ops::add(z1, Ops::mul(x[2], FIX_0_765366865));
+
+    // Every output gets either tmp0 or tmp1, which is where the rounding bias goes
+    V rounding = Ops::set(bias);
+    V tmp0 = Ops::add(Ops::shl(Ops::add(x[0], x[4]), IDCT_CONST_BITS), rounding);
+    V tmp1 = Ops::add(Ops::shl(Ops::sub(x[0], x[4]), IDCT_CONST_BITS), rounding);
+
+    V tmp10 = Ops::add(tmp0, tmp3);
+    V tmp13 = Ops::sub(tmp0, tmp3);
+    V tmp11 = Ops::add(tmp1, tmp2);
+    V tmp12 = Ops::sub(tmp1, tmp2);
+
+    // Odd part
+    V o0 = x[7];
+    V o1 = x[5];
+    V o2 = x[3];
+    V o3 = x[1];
+
+    z1 = Ops::add(o0, o3);
+    V z2 = Ops::add(o1, o2);
+    V z3 = Ops::add(o0, o2);
+    V z4 = Ops::add(o1, o3);
+    V z5 = Ops::mul(Ops::add(z3, z4), FIX_1_175875602);
+
+    o0 = Ops::mul(o0, FIX_0_298631336);
+    o1 = Ops::mul(o1, FIX_2_053119869);
+    o2 = Ops::mul(o2, FIX_3_072711026);
+    o3 = Ops::mul(o3, FIX_1_501321110);
+    z1 = Ops::mul(z1, -FIX_0_899976223);
+    z2 = Ops::mul(z2, -FIX_2_562915447);
+    z3 = Ops::add(Ops::mul(z3, -FIX_1_961570560), z5);
+    z4 = Ops::add(Ops::mul(z4, -FIX_0_390180644), z5);
+
+    o0 = Ops::add(o0, Ops::add(z1, z3));
+    o1 = Ops::add(o1, Ops::add(z2, z4));
+    o2 = Ops::add(o2, Ops::add(z2, z3));
+    o3 = Ops::add(o3, Ops::add(z1, z4));
+
+    x[0] = Ops::sra(Ops::add(tmp10, o3), shift);
+    x[7] = Ops::sra(Ops::sub(tmp10, o3), shift);
+    x[1] = Ops::sra(Ops::add(tmp11, o2), shift);
+    x[6] = Ops::sra(Ops::sub(tmp11, o2), shift);
+    x[2] = Ops::sra(Ops::add(tmp12, o1), shift);
+    x[5] = Ops::sra(Ops::sub(tmp12, o1), shift);
+    x[3] = Ops::sra(Ops::add(tmp13, o0), shift);
+    x[4] = Ops::sra(Ops::sub(tmp13, o0), shift);
+}
+
+// Full 8x8 IDCT: a column pass with lanes = columns, a transpose, a row pass with lanes = rows and a final
+// transpose back to rows of samples.
+template <class Ops>
+inline void idct_8x8(const short *coefficients, const short *multipliers, unsigned char *output, int stride) {
+    typename Ops::Vector x[8];
+    for (int k = 0; k < 8; k++) {
+        x[k] = Ops::load_dequantize(coefficients + 8 * k, multipliers + 8 * k);
+    }
+    idct_1d<Ops>(x, IDCT_PASS1_SHIFT, IDCT_PASS1_BIAS);
+    Ops::transpose(x);
+    idct_1d<Ops>(x, IDCT_PASS2_SHIFT, IDCT_PASS2_BIAS);
+    Ops::transpose(x);
+    for (int k = 0; k < 8; k++) {
+        Ops::store_samples(x[k], output + k * stride);
+    }
+}
+
+// Shifts of the 4x4 IDCT passes, which have one more bit of scale than the 8x8 ones.
+constexpr int IDCT4_PASS1_SHIFT = IDCT_CONST_BITS - IDCT_PASS1_BITS + 1;
+constexpr int IDCT4_PASS1_BIAS = 1 << (IDCT4_PASS1_SHIFT - 1);
+constexpr int IDCT4_PASS2_SHIFT = IDCT_CONST_BITS + IDCT_PASS1_BITS + 3 + 1;
+constexpr int IDCT4_PASS2_BIAS = (1 << (IDCT4_PASS2_SHIFT - 1)) + (128 << IDCT4_PASS2_SHIFT);
+
+// 4-point IDCT of x[0..7] (x[4] does not contribute) into x[0..3].
+template <class Ops>
+inline void idct_4_1d(typename Ops::Vector (&x)[8], int shift, int bias) {
+    using V = typename Ops::Vector;
+
+    V tmp0 = Ops::add(Ops::shl(x[0], IDCT_CONST_BITS + 1), Ops::set(bias));
+    V tmp2 = Ops::sub(Ops::mul(x[2], FIX_1_847759065), Ops::mul(x[6], FIX_0_765366865));
+    V tmp10 = Ops::add(tmp0, tmp2);
+    V tmp12 = Ops::sub(tmp0, tmp2);
+
+    V odd0 = Ops::add(Ops::sub(Ops::mul(x[5], FIX_1_451774981), Ops::mul(x[7], FIX_0_211164243)),
+                      Ops::sub(Ops::mul(x[1], FIX_1_061594337), Ops::mul(x[3], FIX_2_172734803)));
+    V odd2 = Ops::sub(Ops::add(Ops::mul(x[3], FIX_0_899976223), Ops::mul(x[1], FIX_2_562915447)),
+                      Ops::add(Ops::mul(x[7], FIX_0_509795579), Ops::mul(x[5], FIX_0_601344887)));
+
+    x[0] = Ops::sra(Ops::add(tmp10, odd2), shift);
+    x[3] = Ops::sra(Ops::sub(tmp10, odd2), shift);
+    x[1] = Ops::sra(Ops::add(tmp12, odd0), shift);
+    x[2] = Ops::sra(Ops::sub(tmp12, odd0), shift);
+}
+
+// Reduced 4x4 IDCT, with the same layout as idct_8x8(): only the first 4 lanes of the row pass are used.
+template <class Ops>
+inline void idct_4x4(const short *coefficients, const short *multipliers, unsigned char *output, int stride) {
+    typename Ops::Vector x[8];
+    for (int k = 0; k < 8; k++) {
+        x[k] = Ops::load_dequantize(coefficients + 8 * k, multipliers + 8 * k);
+    }
+    idct_4_1d<Ops>(x, IDCT4_PASS1_SHIFT, IDCT4_PASS1_BIAS);
+    for (int k = 4; k < 8; k++) {
+        x[k] = Ops::set(0);
+    }
+    Ops::transpose(x);
+    idct_4_1d<Ops>(x, IDCT4_PASS2_SHIFT, IDCT4_PASS2_BIAS);
+    Ops::transpose(x);
+    for (int k = 0; k < 4; k++) {
+        // The stores write 8 samples, which would overwrite the next block.
+        unsigned char samples[8];
+        Ops::store_samples(x[k], samples);
+        std::memcpy(output + k * stride, samples, 4);
+    }
+}
+
+constexpr int IDCT2_PASS1_SHIFT = IDCT_CONST_BITS - IDCT_PASS1_BITS + 2;
+constexpr int IDCT2_PASS1_BIAS = 1 << (IDCT2_PASS1_SHIFT - 1);
+constexpr int IDCT2_PASS2_SHIFT = IDCT_CONST_BITS + IDCT_PASS1_BITS + 3 + 2;
+constexpr int IDCT2_PASS2_BIAS = (1 << (IDCT2_PASS2_SHIFT - 1)) + (128 << IDCT2_PASS2_SHIFT);
+
+// 2-point IDCT of x[0], x[1], x[3], x[5] and x[7] into x[0..1].
+template <class Ops>
+inline void idct_2_1d(typename Ops::Vector (&x)[8], int shift, int bias) {
+    using V = typename Ops::Vector;
+
+    V tmp10 = Ops::add(Ops::shl(x[0], IDCT_CONST_BITS + 2), Ops::set(bias));
+    V tmp0 = Ops::add(Ops::sub(Ops::mul(x[5], FIX_0_850430095), Ops::mul(x[7], FIX_0_720959822)),
+                      Ops::sub(Ops::mul(x[1], FIX_3_624509785), Ops::mul(x[3], FIX_1_272758580)));
+    x[0] = Ops::sra(Ops::add(tmp10, tmp0), shift);
+    x[1] = Ops::sra(Ops::sub(tmp10, tmp0), shift);
+}
+
+template <class Ops>
+inline void idct_2x2(const short *coefficients, const short *multipliers, unsigned char *output, int stride) {
+    typename Ops::Vector x[8];
+    for (int k = 0; k < 8; k++) {
+        x[k] = Ops::load_dequantize(coefficients + 8 * k, multipliers + 8 * k);
+    }
+    idct_2_1d<Ops>(x, IDCT2_PASS1_SHIFT, IDCT2_PASS1_BIAS);
+    for (int k = 2; k < 8; k++) {
+        x[k] = Ops::set(0);
+    }
+    Ops::transpose(x);
+    idct_2_1d<Ops>(x, IDCT2_PASS2_SHIFT, IDCT2_PASS2_BIAS);
+    Ops::transpose(x);
+    for (int k = 0; k < 2; k++) {
+        unsigned char samples[8];
+        Ops::store_samples(x[k], samples);
+        std::memcpy(output + k * stride, samples, 2);
+    }
+}
+
+#endif //UNTITLED_IDCT_KERNEL_H
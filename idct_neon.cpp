@@ -0,0 +1,84 @@
+#include "idct.h"
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+
+#include <arm_neon.h>
+
+#include "idct_kernel.h"
+
+namespace {
+
+// 8 32-bit lanes, as two NEON registers.
+struct NEONOps {
+    struct Vector {
+        int32x4_t lo;
+        int32x4_t hi;
+    };
+
+    static Vector set(int value) {
+        int32x4_t v = vdupq_n_s32(value);
+        return Vector {v, v};
+    }
+    static Vector add(Vector a, Vector b) { return Vector {vaddq_s32(a.lo, b.lo), vaddq_s32(a.hi, b.hi)}; }
+    static Vector sub(Vector a, Vector b) { return Vector {vsubq_s32(a.lo, b.lo), vsubq_s32(a.hi, b.hi)}; }
+    static Vector mul(Vector a, int constant) {
+        return Vector {vmulq_n_s32(a.lo, constant), vmulq_n_s32(a.hi, constant)};
+    }
+    static Vector shl(Vector a, int count) {
+        int32x4_t c = vdupq_n_s32(count);
+        return Vector {vshlq_s32(a.lo, c), vshlq_s32(a.hi, c)};
+    }
+    static Vector sra(Vector a, int count) {
+        // vshlq shifts right for negative counts.
+        int32x4_t c = vdupq_n_s32(-count);
+        return Vector {vshlq_s32(a.lo, c), vshlq_s32(a.hi, c)};
+    }
+
+    static Vector load_dequantize(const short *coefficients, const short *multipliers) {
+        int16x8_t c = vld1q_s16(coefficients);
+        int16x8_t m = vld1q_s16(multipliers);
+        return Vector {vmull_s16(vget_low_s16(c), vget_low_s16(m)), vmull_s16(vget_high_s16(c), vget_high_s16(m))};
+    }
+
+    static void store_samples(Vector a, unsigned char *output) {
+        int16x8_t words = vcombine_s16(vqmovn_s32(a.lo), vqmovn_s32(a.hi));
+        vst1_u8(output, vqmovun_s16(words));
+    }
+
+    static void transpose4(int32x4_t &r0, int32x4_t &r1, int32x4_t &r2, int32x4_t &r3) {
+        int32x4x2_t t01 = vtrnq_s32(r0, r1);
+        int32x4x2_t t23 = vtrnq_s32(r2, r3);
+        r0 = vcombine_s32(vget_low_s32(t01.val[0]), vget_low_s32(t23.val[0]));
+        r1 = vcombine_s32(vget_low_s32(t01.val[1]), vget_low_s32(t23.val[1]));
+        r2 = vcombine_s32(vget_high_s32(t01.val[0]), vget_high_s32(t23.val[0]));
+        r3 = vcombine_s32(vget_high_s32(t01.val[1]), vget_high_s32(t23.val[1]));
+    }
+
+    static void transpose(Vector (&x)[8]) {
+        transpose4(x[0].lo, x[1].lo, x[2].lo, x[3].lo);
+        transpose4(x[0].hi, x[1].hi, x[2].hi, x[3].hi);
+        transpose4(x[4].lo, x[5].lo, x[6].lo, x[7].lo);
+        transpose4(x[4].hi, x[5].hi, x[6].hi, x[7].hi);
+        for (int k = 0; k < 4; k++) {
+            int32x4_t t = x[k].hi;
+            x[k].hi = x[k + 4].lo;
+            x[k + 4].lo = t;
+        }
+    }
+};
+
+}
+
+void idct_neon(const short *coefficients, const short *multipliers, unsigned char *output, int stride) {
+    idct_8x8<NEONOps>(coefficients, multipliers, output, stride);
+}
+
+void idct_4x4_neon(const short *coefficients, const short *multipliers, unsigned char *output, int stride) {
+    idct_4x4<NEONOps>(coefficients, multipliers, output, stride);
+}
+
+void idct_2x2_neon(const short *coefficients, const short *multipliers, unsigned char *output, int stride) {
+    idct_2x2<NEONOps>(coefficients, multipliers, output, stride);
+}
+
+#endif
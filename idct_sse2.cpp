@@ -0,0 +1,98 @@
+#include "idct.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+
+#include <emmintrin.h>
+
+#include "idct_kernel.h"
+
+namespace {
+
+// 8 32-bit lanes, as two SSE2 registers.
+struct SSE2Ops {
+    struct Vector {
+        __m128i lo;
+        __m128i hi;
+    };
+
+    static Vector set(int value) {
+        __m128i v = _mm_set1_epi32(value);
+        return Vector {v, v};
+    }
+    static Vector add(Vector a, Vector b) { return Vector {_mm_add_epi32(a.lo, b.lo), _mm_add_epi32(a.hi, b.hi)}; }
+    static Vector sub(Vector a, Vector b) { return Vector {_mm_sub_epi32(a.lo, b.lo), _mm_sub_epi32(a.hi, b.hi)}; }
+
+    // SSE2 has no 32-bit multiply-low, emulate it with two 32x32->64 multiplies.
+    static __m128i mullo(__m128i a, __m128i b) {
+        __m128i even = _mm_mul_epu32(a, b);
+        __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+        return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                                  _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+    }
+    static Vector mul(Vector a, int constant) {
+        __m128i c = _mm_set1_epi32(constant);
+        return Vector {mullo(a.lo, c), mullo(a.hi, c)};
+    }
+    static Vector shl(Vector a, int count) {
+        __m128i c = _mm_cvtsi32_si128(count);
+        return Vector {_mm_sll_epi32(a.lo, c), _mm_sll_epi32(a.hi, c)};
+    }
+    static Vector sra(Vector a, int count) {
+        __m128i c = _mm_cvtsi32_si128(count);
+        return Vector {_mm_sra_epi32(a.lo, c), _mm_sra_epi32(a.hi, c)};
+    }
+
+    static Vector load_dequantize(const short *coefficients, const short *multipliers) {
+        __m128i c = _mm_load_si128((const __m128i *) coefficients);
+        __m128i m = _mm_load_si128((const __m128i *) multipliers);
+        // Full 16x16->32 products, from their low and high halves.
+        __m128i lo = _mm_mullo_epi16(c, m);
+        __m128i hi = _mm_mulhi_epi16(c, m);
+        return Vector {_mm_unpacklo_epi16(lo, hi), _mm_unpackhi_epi16(lo, hi)};
+    }
+
+    static void store_samples(Vector a, unsigned char *output) {
+        __m128i words = _mm_packs_epi32(a.lo, a.hi);
+        _mm_storel_epi64((__m128i *) output, _mm_packus_epi16(words, words));
+    }
+
+    static void transpose4(__m128i &r0, __m128i &r1, __m128i &r2, __m128i &r3) {
+        __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+        __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+        __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+        __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+        r0 = _mm_unpacklo_epi64(t0, t1);
+        r1 = _mm_unpackhi_epi64(t0, t1);
+        r2 = _mm_unpacklo_epi64(t2, t3);
+        r3 = _mm_unpackhi_epi64(t2, t3);
+    }
+
+    // Transposes the four 4x4 quadrants, then swaps the two off-diagonal ones.
+    static void transpose(Vector (&x)[8]) {
+        transpose4(x[0].lo, x[1].lo, x[2].lo, x[3].lo);
+        transpose4(x[0].hi, x[1].hi, x[2].hi, x[3].hi);
+        transpose4(x[4].lo, x[5].lo, x[6].lo, x[7].lo);
+        transpose4(x[4].hi, x[5].hi, x[6].hi, x[7].hi);
+        for (int k = 0; k < 4; k++) {
+            __m128i t = x[k].hi;
+            x[k].hi = x[k + 4].lo;
+            x[k + 4].lo = t;
+        }
+    }
+};
+
+}
+
+void idct_sse2(const short *coefficients, const short *multipliers, unsigned char *output, int stride) {
+    idct_8x8<SSE2Ops>(coefficients, multipliers, output, stride);
+}
+
+void idct_4x4_sse2(const short *coefficients, const short *multipliers, unsigned char *output, int stride) {
+    idct_4x4<SSE2Ops>(coefficients, multipliers, output, stride);
+}
+
+void idct_2x2_sse2(const short *coefficients, const short *multipliers, unsigned char *output, int stride) {
+    idct_2x2<SSE2Ops>(coefficients, multipliers, output, stride);
+}
+
+#endif
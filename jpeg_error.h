@@ -0,0 +1,18 @@
+#ifndef UNTITLED_JPEG_ERROR_H
+#define UNTITLED_JPEG_ERROR_H
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+// Invalid or unsupported content, found at byte offset() of the file.
+class JPEGError: public std::runtime_error {
+public:
+    JPEGError(const std::string &message, size_t offset): std::runtime_error(message), position(offset) {}
+    size_t offset() const noexcept { return position; }
+
+private:
+    size_t position;
+};
+
+#endif //UNTITLED_JPEG_ERROR_H
@@ -0,0 +1,381 @@
+#include "jpeg_parser.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <tuple>
+
+#include "byte_cursor.h"
+#include "scan_decoder.h"
+#include "table_cache.h"
+#include "utils.h"
+
+JPEGParser::JPEGParser(std::vector<unsigned char> data) noexcept:
+owned_data(std::move(data)), raw_data(owned_data), index(0), table_cache(&TableCache::shared()) {}
+
+JPEGParser::JPEGParser(std::span<const unsigned char> data) noexcept:
+raw_data(data), index(0), table_cache(&TableCache::shared()) {}
+
+JFIFData JPEGParser::parse_jfif_data(ByteCursor &segment, Arena &arena) {
+    segment.skip(5); // Ignores the 5 (constant) identifier bytes
+
+    segment.require(9);
+    JFIFVersion version {};
+    version.major = segment.u8();
+    version.minor = segment.u8();
+    DensityUnit density_unit = (DensityUnit) segment.u8();
+    unsigned short x_density = segment.u16();
+    unsigned short y_density = segment.u16();
+    unsigned char x_thumbnail = segment.u8();
+    unsigned char y_thumbnail = segment.u8();
+
+    // 3 bytes per pixel, right after the header.
+    std::span<const unsigned char> pixels = segment.bytes((size_t) x_thumbnail * y_thumbnail * 3);
+    std::span<RGB> thumbnail_data = arena.allocate_array<RGB>(pixels.size() / 3);
+    for (size_t i = 0; i < thumbnail_data.size(); i++) {
+        thumbnail_data[i] = RGB {pixels[3 * i], pixels[3 * i + 1], pixels[3 * i + 2]};
+    }
+    return JFIFData {version, density_unit, x_density, y_density, x_thumbnail, y_thumbnail, thumbnail_data};
+}
+
+QuantizationTable QuantizationTable::from_data(const std::array<unsigned short, 64> &data) {
+    QuantizationTable table {data, {}};
+    for (int k = 0; k < 64; k++) {
+        // 16-bit tables can hold values the 16-bit IDCT inputs cannot represent, those are saturated.
+        table.idct_multipliers[ZIGZAG[k]] = (short) std::min<unsigned short>(data[k], 0x7fff);
+    }
+    return table;
+}
+
+QuantizationTable JPEGParser::parse_quantization_table(ByteCursor &segment, unsigned char precision) {
+    // Precision 0 if the Quantization table contains 8-bit integers, 1 if it contains 16-bit integers.
+    std::span<const unsigned char> table_data = segment.bytes(precision == 0 ? 64 : 128);
+    return table_cache->quantization(table_data, precision);
+}
+
+void JPEGParser::parse_huffman_table(ByteCursor &segment, HuffmanTable &table, HuffmanDecoder &decoder) {
+    std::span<const unsigned char> size_data = segment.bytes(16);
+    int codes_count = std::accumulate(size_data.begin(), size_data.end(), (int) 0);
+    std::array<unsigned char, 16> lengths {};
+    std::copy(size_data.begin(), size_data.end(), lengths.begin());
+    // More codes than values, or than codes of each length fit in that length.
+    if (codes_count > 256 || !HuffmanTable::valid_size_data(lengths)) {
+        throw JPEGError("Invalid Huffman table", segment.offset());
+    }
+    segment.skip(codes_count);
+
+    // The code counts and the values that follow them.
+    table_cache->huffman({size_data.data(), (size_t) 16 + codes_count}, table, decoder);
+}
+
+FrameHeader JPEGParser::parse_frame_header(ByteCursor &segment) {
+    FrameHeader frame {};
+    segment.require(6);
+    frame.precision = segment.u8();
+    frame.height = segment.u16();
+    frame.width = segment.u16();
+    frame.components_nbr = segment.u8();
+
+    if (frame.precision != 8) {
+        throw JPEGError("Only 8-bit samples are supported", segment.offset());
+    }
+    // A height of 0 means it is defined later by a DNL marker, which is not supported.
+    if (frame.width == 0 || frame.height == 0) {
+        throw JPEGError("Invalid frame dimensions", segment.offset());
+    }
+    if (frame.components_nbr == 0 || frame.components_nbr > 4) {
+        throw JPEGError("Invalid number of components", segment.offset());
+    }
+
+    frame.h_max = 1;
+    frame.v_max = 1;
+    segment.require(frame.components_nbr * 3);
+    for (int i = 0; i < frame.components_nbr; i++) {
+        FrameComponent &component = frame.components[i];
+        component.id = segment.u8();
+        std::tie(component.h, component.v) = segment.u4_pair();
+        component.q_table_id = segment.u8();
+
+        if (component.h == 0 || component.h > 4 || component.v == 0 || component.v > 4 || component.q_table_id > 3) {
+            throw JPEGError("Invalid frame component", segment.offset());
+        }
+        frame.h_max = std::max(frame.h_max, component.h);
+        frame.v_max = std::max(frame.v_max, component.v);
+    }
+    return frame;
+}
+
+ScanHeader JPEGParser::parse_scan_header(ByteCursor &segment, const FrameHeader &frame) {
+    ScanHeader scan {};
+    segment.require(1);
+    scan.components_nbr = segment.u8();
+
+    if (scan.components_nbr == 0 || scan.components_nbr > frame.components_nbr) {
+        throw JPEGError("Invalid number of scan components", segment.offset());
+    }
+
+    segment.require(scan.components_nbr * 2 + 3);
+    for (int i = 0; i < scan.components_nbr; i++) {
+        unsigned char component_id = segment.u8();
+        ScanComponent &component = scan.components[i];
+        component.frame_index = frame.components_nbr;
+        for (int j = 0; j < frame.components_nbr; j++) {
+            if (frame.components[j].id == component_id) {
+                component.frame_index = j;
+            }
+        }
+        std::tie(component.dc_table_id, component.ac_table_id) = segment.u4_pair();
+
+        if (component.frame_index == frame.components_nbr || component.dc_table_id > 3 || component.ac_table_id > 3) {
+            throw JPEGError("Invalid scan component", segment.offset());
+        }
+    }
+
+    scan.spectral_start = segment.u8();
+    scan.spectral_end = segment.u8();
+    std::tie(scan.approx_high, scan.approx_low) = segment.u4_pair();
+    return scan;
+}
+
+// Checks the spectral selection and successive approximation parameters of a progressive scan.
+static bool valid_progression(const ScanHeader &scan) {
+    // DC and AC coefficients always go in different scans, and the AC ones of one component at a time.
+    if (scan.spectral_start == 0) {
+        if (scan.spectral_end != 0) {
+            return false;
+        }
+    } else if (scan.spectral_end < scan.spectral_start || scan.spectral_end > 63 || scan.components_nbr != 1) {
+        return false;
+    }
+    // Refinement scans add a single bit.
+    return scan.approx_low <= 13 && (scan.approx_high == 0 || scan.approx_high == scan.approx_low + 1);
+}
+
+unsigned char JPEGParser::parse_segment(JPEGEncoded &encoded, ScanHeader &scan) {
+    size_t start = index;
+    while (true) {
+        if (index + 1 >= raw_data.size()) {
+            index = start;
+            return 0;
+        }
+        if (raw_data[index] != 0xff) {
+            throw JPEGError("Expected a marker", index);
+        }
+        unsigned char marker = raw_data[index + 1];
+        // Any number of 0xff fill bytes may precede a marker
+        if (marker == 0xff) {
+            index += 1;
+            continue;
+        }
+        index += 2;
+
+        // Those markers have no length, so they must be treated separately
+        if (marker == 0xd8 or marker == 0xd9) {
+            if (diagnostics) {
+                diagnostics(Diagnostic {Diagnostic::Kind::Segment, marker, index - 2, 0});
+            }
+            last_marker = marker;
+            return marker;
+        }
+
+        if (index + 2 > raw_data.size()) {
+            index = start;
+            return 0;
+        }
+        unsigned short length = ((unsigned short)raw_data[index] << 8) + raw_data[index + 1];
+        size_t segment_end = index + length;
+        if (segment_end > raw_data.size()) {
+            index = start;
+            return 0;
+        }
+        if (length < 2) {
+            throw JPEGError("Invalid segment length", index);
+        }
+        index += 2;
+
+        size_t marker_offset = index - 4;
+        Diagnostic::Kind kind = Diagnostic::Kind::Segment;
+        // The segment is entirely in the data, its content is read through the cursor from now on.
+        ByteCursor segment {raw_data.subspan(index, length - 2), index};
+
+        switch (marker) {
+            case 0xe0: {
+                // APP0 is also used by extensions of JFIF, such as JFXX.
+                std::span<const unsigned char> identifier = raw_data.subspan(index, std::min<size_t>(length - 2, 5));
+                if (identifier.size() == 5 && std::equal(identifier.begin(), identifier.end(), "JFIF")) {
+                    encoded.metadata = parse_jfif_data(segment, encoded.arena);
+                } else {
+                    kind = Diagnostic::Kind::IgnoredSegment;
+                }
+                break;
+            }
+            case 0xdb: {
+                while (segment.remaining() > 0) {
+                    auto [precision, identifier] = segment.u4_pair();
+                    // Index (ranging from 0 to 3) of the table
+                    if (identifier > 3) {
+                        throw JPEGError("Invalid quantization table identifier", segment.offset());
+                    }
+                    encoded.q_tables[identifier] = parse_quantization_table(segment, precision);
+                    encoded.q_tables_nbr = std::max<unsigned char>(encoded.q_tables_nbr, identifier + 1);
+                };
+                break;
+            }
+            case 0xc4: {
+                while (segment.remaining() > 0) {
+                    auto [table_class, table_dest_id] = segment.u4_pair();
+                    if (table_dest_id > 3) {
+                        throw JPEGError("Invalid Huffman table destination", segment.offset());
+                    }
+                    // Built in place, HuffmanTable being a fairly large (but allocation free) structure.
+                    if (table_class == 0) {
+                        parse_huffman_table(segment, encoded.huffman_dc_tables[table_dest_id],
+                                            dc_decoders[table_dest_id]);
+                    } else {
+                        parse_huffman_table(segment, encoded.huffman_ac_tables[table_dest_id],
+                                            ac_decoders[table_dest_id]);
+                    }
+                };
+                break;
+            }
+            case 0xc0:
+            case 0xc1:
+            case 0xc2:
+                encoded.frame = parse_frame_header(segment);
+                encoded.frame.progressive = marker == 0xc2;
+                break;
+            // Lossless, hierarchical and arithmetic coding frames
+            case 0xc3:
+            case 0xc5:
+            case 0xc6:
+            case 0xc7:
+            case 0xc9:
+            case 0xca:
+            case 0xcb:
+            case 0xcd:
+            case 0xce:
+            case 0xcf:
+                throw JPEGError("Unsupported JPEG process", marker_offset);
+            case 0xdd:
+                segment.require(2);
+                encoded.restart_interval = segment.u16();
+                break;
+            case 0xda: {
+                if (encoded.frame.components_nbr == 0) {
+                    throw JPEGError("Scan before frame header", marker_offset);
+                }
+                scan = parse_scan_header(segment, encoded.frame);
+                if (encoded.frame.progressive && !valid_progression(scan)) {
+                    throw JPEGError("Invalid progressive scan", marker_offset);
+                }
+                break;
+            }
+            default:
+                kind = Diagnostic::Kind::IgnoredSegment;
+                break;
+        }
+        // Whatever the segment has left is ignored, for SOS the entropy-coded data starts there.
+        index = segment_end;
+        if (diagnostics) {
+            diagnostics(Diagnostic {kind, marker, marker_offset, length});
+        }
+        last_marker = marker;
+        return marker;
+    }
+}
+
+void JPEGParser::parse_until_scan(JPEGEncoded &encoded, ScanHeader &scan) {
+    unsigned char marker;
+    do {
+        marker = parse_segment(encoded, scan);
+        if (marker == 0 || marker == 0xd9) {
+            throw JPEGError("No scan to decode", index);
+        }
+    } while (marker != 0xda);
+}
+
+ComponentCoefficients ComponentCoefficients::allocate(int blocks_x, int blocks_y, Arena &arena) {
+    std::span<short> data = arena.allocate_array<short>((size_t) blocks_x * blocks_y * 64, COEFFICIENT_ALIGNMENT);
+    std::fill(data.begin(), data.end(), 0);
+    return ComponentCoefficients {blocks_x, blocks_y, data};
+}
+
+void JPEGEncoded::allocate_coefficients() {
+    coefficients.resize(frame.components_nbr);
+    for (int i = 0; i < frame.components_nbr; i++) {
+        coefficients[i] = ComponentCoefficients::allocate(frame.mcus_x() * frame.components[i].h,
+                                                          frame.mcus_y() * frame.components[i].v, arena);
+    }
+}
+
+void JPEGEncoded::reset() {
+    metadata = JFIFData {};
+    q_tables_nbr = 0;
+    restart_interval = 0;
+    frame = FrameHeader {};
+    coefficients.clear();
+    stats = DecodeStats {};
+    arena.reset();
+}
+
+void JPEGParser::reset(std::span<const unsigned char> data) noexcept {
+    owned_data.clear();
+    raw_data = data;
+    index = 0;
+    last_marker = 0;
+    dc_decoders = {};
+    ac_decoders = {};
+}
+
+JPEGEncoded JPEGParser::parse() {
+    JPEGEncoded encoded {};
+    parse(encoded);
+    return encoded;
+}
+
+void JPEGParser::parse(JPEGEncoded &encoded) {
+    parse(encoded, {});
+}
+
+void JPEGParser::parse(JPEGEncoded &encoded, const std::function<void()> &on_scan) {
+    ScanHeader scan {};
+    while (index < raw_data.size()) {
+        unsigned char marker;
+        {
+            StageTimer timer {&encoded.stats, &DecodeStats::marker_ns};
+            marker = parse_segment(encoded, scan);
+        }
+        // Unlike the incremental interface, the whole file is there: a segment it cuts is an error.
+        if (marker == 0) {
+            throw JPEGError("Truncated file", index);
+        }
+        if (is_supported_frame(marker)) {
+            encoded.allocate_coefficients();
+        }
+        if (marker == 0xda) {
+            ScanDecoder decoder {encoded.frame, scan, dc_decoders, ac_decoders, encoded.restart_interval};
+            // The shared pool is only started for scans that can use it.
+            ThreadPool *pool = thread_pool;
+            if (pool == nullptr && encoded.restart_interval != 0) {
+                pool = &ThreadPool::shared();
+            }
+            size_t length;
+            {
+                StageTimer timer {&encoded.stats, &DecodeStats::entropy_ns};
+                length = decoder.decode(raw_data.data() + index, raw_data.size() - index, encoded.coefficients, pool);
+            }
+            index += length;
+            if constexpr (collect_stats) {
+                encoded.stats.entropy_bytes += length;
+                encoded.stats.refills += decoder.refills();
+            }
+            if (on_scan) {
+                on_scan();
+            }
+        }
+    }
+    // Including a scan cut short, for which the entropy decoder made up the missing bits.
+    if (last_marker != 0xd9) {
+        throw JPEGError("Truncated file", index);
+    }
+}
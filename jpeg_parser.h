@@ -0,0 +1,227 @@
+#ifndef UNTITLED_JPEG_PARSER_H
+#define UNTITLED_JPEG_PARSER_H
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <vector>
+
+#include "arena.h"
+#include "decode_stats.h"
+#include "huffman.h"
+#include "jpeg_error.h"
+#include "thread_pool.h"
+
+enum class DensityUnit {NoUnit, PixelPerInch, PixelPerCm};
+
+struct RGB {
+    unsigned char r;
+    unsigned char g;
+    unsigned char b;
+};
+
+struct JFIFVersion {
+    unsigned char major;
+    unsigned char minor;
+};
+
+
+struct JFIFData {
+    JFIFVersion version;
+    DensityUnit density_unit;
+    unsigned short x_density;
+    unsigned short y_density;
+    unsigned char x_thumbnail;
+    unsigned char y_thumbnail;
+    // In the arena of the JPEGEncoded, like the coefficients.
+    std::span<const RGB> thumbnail_data;
+};
+
+
+struct QuantizationTable  {
+    // Quantization values, in zig-zag order as stored in the DQT segment.
+    std::array<unsigned short, 64> data;
+    // The same values in natural order, as the IDCT scale factors (see idct.h). Computed once at DQT parse
+    // time so that dequantization is done in the IDCT pass. Aligned for the SIMD loads, like the coefficients.
+    alignas(16) std::array<short, 64> idct_multipliers;
+
+    static QuantizationTable from_data(const std::array<unsigned short, 64> &data);
+};
+
+struct FrameComponent {
+    unsigned char id;
+    // Sampling factors, ranging from 1 to 4.
+    unsigned char h;
+    unsigned char v;
+    unsigned char q_table_id;
+};
+
+struct FrameHeader {
+    unsigned char precision;
+    unsigned short height;
+    unsigned short width;
+    unsigned char components_nbr;
+    std::array<FrameComponent, 4> components;
+    unsigned char h_max;
+    unsigned char v_max;
+    // Whether the coefficients are spread over several scans (SOF2), rather than sequential (SOF0 and SOF1).
+    bool progressive;
+
+    int mcus_x() const { return (width + 8 * h_max - 1) / (8 * h_max); }
+    int mcus_y() const { return (height + 8 * v_max - 1) / (8 * v_max); }
+};
+
+// Start Of Frame markers of the supported processes, all with Huffman coding: baseline, extended sequential
+// (only with 8-bit samples) and progressive.
+constexpr bool is_supported_frame(unsigned char marker) {
+    return marker == 0xc0 || marker == 0xc1 || marker == 0xc2;
+}
+
+struct ScanComponent {
+    // Index of the component in FrameHeader::components (not its identifier).
+    unsigned char frame_index;
+    unsigned char dc_table_id;
+    unsigned char ac_table_id;
+};
+
+struct ScanHeader {
+    unsigned char components_nbr;
+    std::array<ScanComponent, 4> components;
+    // Spectral selection and successive approximation. Always 0, 63, 0, 0 for sequential frames.
+    unsigned char spectral_start;
+    unsigned char spectral_end;
+    unsigned char approx_high;
+    unsigned char approx_low;
+};
+
+// Alignment of the coefficients of each component: a cache line, so that with 128 bytes per block, no block
+// straddles two lines and every row of 8 coefficients can be loaded with aligned SIMD loads.
+constexpr size_t COEFFICIENT_ALIGNMENT = 64;
+
+// Quantized DCT coefficients of one component, 64 per block in natural (not zig-zag) order.
+// The block grid is padded to a whole number of MCUs and stored row after row, so the blocks of an MCU row are
+// contiguous: the IDCT of an MCU row reads the memory the entropy decoder just wrote, front to back.
+struct ComponentCoefficients {
+    int blocks_x;
+    int blocks_y;
+    std::span<short> data;
+
+    // Zeroed blocks, taken from `arena` with COEFFICIENT_ALIGNMENT.
+    static ComponentCoefficients allocate(int blocks_x, int blocks_y, Arena &arena);
+
+    short *block(int bx, int by) { return data.data() + ((long long) by * blocks_x + bx) * 64; }
+    const short *block(int bx, int by) const { return data.data() + ((long long) by * blocks_x + bx) * 64; }
+};
+
+struct JPEGEncoded {
+    JFIFData metadata;
+    std::array<QuantizationTable, 4> q_tables;
+    unsigned char q_tables_nbr;
+    // Indexed by destination identifier, which ranges from 0 to 3.
+    std::array<HuffmanTable, 4> huffman_ac_tables;
+    std::array<HuffmanTable, 4> huffman_dc_tables;
+    // Number of MCUs between RSTn markers, 0 when there are none.
+    unsigned short restart_interval;
+    FrameHeader frame;
+    std::vector<ComponentCoefficients> coefficients;
+    // Time spent on the stages of the decoding, filled by JPEGParser::parse() and Decoder when built with
+    // JPEG_DECODER_STATS (see decode_stats.h).
+    DecodeStats stats;
+    // Storage of everything above whose size depends on the image, freed at once by reset(). A JPEGEncoded
+    // reused for many images thus stops allocating once it has gone through the largest one.
+    Arena arena;
+
+    // Sizes `coefficients` for the frame header and clears them, taking the storage from the arena.
+    // Done by JPEGParser::parse() at the frame header, but left to the callers of parse_segment(), which may
+    // not need the coefficients of the whole frame at once.
+    void allocate_coefficients();
+    // Clears everything for another image, but keeps the memory of the arena for the next one.
+    // Until allocate_coefficients(), `coefficients` is empty and frame.components_nbr is 0.
+    void reset();
+};
+
+// What the parser went through, passed to the DiagnosticCallback of JPEGParser::set_diagnostics().
+struct Diagnostic {
+    enum class Kind {
+        Segment,
+        // Skipped without being understood, e.g. APPn segments other than JFIF.
+        IgnoredSegment,
+    };
+    Kind kind;
+    unsigned char marker;
+    // Offset of the marker in the file, and length of the segment as written after it (0 for SOI and EOI).
+    size_t offset;
+    unsigned short length;
+};
+using DiagnosticCallback = std::function<void(const Diagnostic &diagnostic)>;
+
+class ByteCursor;
+class TableCache;
+
+class JPEGParser {
+public:
+    // Parses the whole file. Throws JPEGError if the data ends before the EOI marker, in a segment or a scan.
+    JPEGEncoded parse();
+    // Parses into an existing JPEGEncoded, reusing the memory of its arena (see JPEGEncoded::reset()).
+    void parse(JPEGEncoded &encoded);
+    // Same, calling `on_scan` once each scan is decoded into `encoded.coefficients`, e.g. to render a preview
+    // of a progressive image after each of its scans.
+    void parse(JPEGEncoded &encoded, const std::function<void()> &on_scan);
+
+    // Incremental interface, for callers that do not have the whole file at hand (see StreamingDecoder).
+    // Parses the next marker segment into `encoded` and returns its marker. For SOS, only the scan header is
+    // parsed (into `scan`), and the entropy-coded data is left to the caller, who skips it with advance().
+    // For frame headers, the coefficients are not allocated (see JPEGEncoded::allocate_coefficients()).
+    // Returns 0 without consuming anything if the data ends before the segment does.
+    unsigned char parse_segment(JPEGEncoded &encoded, ScanHeader &scan);
+    // Parses the segments up to the first scan header (included), for callers decoding the scan themselves.
+    // Throws std::runtime_error if there is none.
+    void parse_until_scan(JPEGEncoded &encoded, ScanHeader &scan);
+    // Replaces the data, which must start with the same bytes (e.g. the same stream with more data appended).
+    void set_data(std::span<const unsigned char> data) noexcept { raw_data = data; }
+    // Starts over with another file, owned by the caller. The tables of the previous one are forgotten.
+    void reset(std::span<const unsigned char> data) noexcept;
+    size_t position() const noexcept { return index; }
+    void advance(size_t bytes) noexcept { index += bytes; }
+    const std::array<HuffmanDecoder, 4> &dc_tables() const noexcept { return dc_decoders; }
+    const std::array<HuffmanDecoder, 4> &ac_tables() const noexcept { return ac_decoders; }
+    // Pool decoding the restart intervals of scans in parallel, ThreadPool::shared() by default. A pool of size
+    // 1 keeps decoding on the calling thread.
+    void set_thread_pool(ThreadPool *pool) noexcept { thread_pool = pool; }
+    // Called for each marker segment, e.g. for logging. Nothing is reported without a callback, which costs a
+    // single test per segment.
+    void set_diagnostics(DiagnosticCallback callback) { diagnostics = std::move(callback); }
+    // Where the DQT and DHT tables are looked up before being built, TableCache::shared() by default. The
+    // cache must outlive the parser.
+    void set_table_cache(TableCache &cache) noexcept { table_cache = &cache; }
+
+    explicit JPEGParser(std::vector<unsigned char> data) noexcept;
+    // Parses a buffer owned by the caller (e.g. a MappedFile), which must outlive the parser. No copy is made.
+    explicit JPEGParser(std::span<const unsigned char> data) noexcept;
+
+    // raw_data may point into owned_data, whose buffer is kept by a move but not by a copy.
+    JPEGParser(JPEGParser &&) noexcept = default;
+    JPEGParser(const JPEGParser &) = delete;
+
+
+private:
+    std::vector<unsigned char> owned_data;
+    std::span<const unsigned char> raw_data;
+    unsigned long long index;
+    // Marker of the last segment parsed, which is EOI once the whole file is.
+    unsigned char last_marker = 0;
+    std::array<HuffmanDecoder, 4> dc_decoders {};
+    std::array<HuffmanDecoder, 4> ac_decoders {};
+    ThreadPool *thread_pool = nullptr;
+    DiagnosticCallback diagnostics;
+    TableCache *table_cache;
+    // Read the content of a segment, whose length was checked against the data.
+    JFIFData parse_jfif_data(ByteCursor &segment, Arena &arena);
+    QuantizationTable parse_quantization_table(ByteCursor &segment, unsigned char precision);
+    void parse_huffman_table(ByteCursor &segment, HuffmanTable &table, HuffmanDecoder &decoder);
+    FrameHeader parse_frame_header(ByteCursor &segment);
+    ScanHeader parse_scan_header(ByteCursor &segment, const FrameHeader &frame);
+};
+
+#endif //UNTITLED_JPEG_PARSER_H
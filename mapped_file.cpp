@@ -0,0 +1,102 @@
+#include "mapped_file.h"
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+MappedFile MappedFile::open(const char *path) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error(std::string("Cannot open ") + path);
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size)) {
+        CloseHandle(file);
+        throw std::runtime_error(std::string("Cannot get the size of ") + path);
+    }
+    // Empty files cannot be mapped, they are simply empty spans.
+    if (file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return MappedFile {nullptr, 0};
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr) {
+        throw std::runtime_error(std::string("Cannot map ") + path);
+    }
+    void *address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    // The view keeps the mapping alive.
+    CloseHandle(mapping);
+    if (address == nullptr) {
+        throw std::runtime_error(std::string("Cannot map ") + path);
+    }
+    return MappedFile {(const unsigned char *) address, (size_t) file_size.QuadPart};
+}
+
+MappedFile::~MappedFile() {
+    if (address != nullptr) {
+        UnmapViewOfFile(address);
+    }
+}
+
+#else
+
+MappedFile MappedFile::open(const char *path) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("Cannot open ") + path);
+    }
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw std::runtime_error(std::string("Cannot get the size of ") + path);
+    }
+    // Empty files cannot be mapped, they are simply empty spans.
+    if (file_stat.st_size == 0) {
+        close(fd);
+        return MappedFile {nullptr, 0};
+    }
+    size_t size = (size_t) file_stat.st_size;
+    void *address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid once the descriptor is closed.
+    close(fd);
+    if (address == MAP_FAILED) {
+        throw std::runtime_error(std::string("Cannot map ") + path);
+    }
+    // The file is read front to back, let the kernel read ahead aggressively.
+    madvise(address, size, MADV_SEQUENTIAL);
+    return MappedFile {(const unsigned char *) address, size};
+}
+
+MappedFile::~MappedFile() {
+    if (address != nullptr) {
+        munmap((void *) address, size);
+    }
+}
+
+#endif
+
+MappedFile::MappedFile(MappedFile &&other) noexcept:
+address(std::exchange(other.address, nullptr)), size(std::exchange(other.size, 0)) {}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        MappedFile old {std::move(*this)};
+        address = std::exchange(other.address, nullptr);
+        size = std::exchange(other.size, 0);
+    }
+    return *this;
+}
@@ -0,0 +1,28 @@
+#ifndef UNTITLED_MAPPED_FILE_H
+#define UNTITLED_MAPPED_FILE_H
+
+#include <cstddef>
+#include <span>
+
+// Read-only memory mapping of a whole file, so that it can be parsed without being copied.
+class MappedFile {
+public:
+    // Throws std::runtime_error if the file cannot be opened or mapped.
+    static MappedFile open(const char *path);
+
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    std::span<const unsigned char> data() const { return {address, size}; }
+
+private:
+    MappedFile(const unsigned char *address, size_t size) noexcept: address(address), size(size) {};
+
+    const unsigned char *address;
+    size_t size;
+};
+
+#endif //UNTITLED_MAPPED_FILE_H
@@ -0,0 +1,62 @@
+#include "probe.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "utils.h"
+
+// SOF0 to SOF15, except DHT (0xc4), JPG (0xc8) and DAC (0xcc) which share the range.
+static bool is_frame_marker(unsigned char marker) {
+    return marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc;
+}
+
+ImageInfo probe(std::span<const unsigned char> data) {
+    if (data.size() < 2 || data[0] != 0xff || data[1] != 0xd8) {
+        throw std::runtime_error("Not a JPEG file");
+    }
+
+    ImageInfo info {};
+    size_t index = 2;
+    while (index + 4 <= data.size()) {
+        if (data[index] != 0xff) {
+            throw std::runtime_error("Expected a marker");
+        }
+        unsigned char marker = data[index + 1];
+        if (marker == 0xff) {
+            index += 1;
+            continue;
+        }
+        if (marker == 0xd8 || (marker >= 0xd0 && marker <= 0xd7) || marker == 0x01) {
+            index += 2;
+            continue;
+        }
+        if (marker == 0xd9 || marker == 0xda) {
+            break;
+        }
+
+        unsigned short length = u8_to_u16(data[index + 2], data[index + 3]);
+        size_t segment = index + 4;
+        size_t segment_end = index + 2 + length;
+        if (length < 2 || segment_end > data.size()) {
+            break;
+        }
+
+        if (marker == 0xe0 && length >= 16 && std::memcmp(data.data() + segment, "JFIF\0", 5) == 0) {
+            info.has_jfif = true;
+            info.version = JFIFVersion {data[segment + 5], data[segment + 6]};
+            info.density_unit = (DensityUnit) data[segment + 7];
+            info.x_density = u8_to_u16(data[segment + 8], data[segment + 9]);
+            info.y_density = u8_to_u16(data[segment + 10], data[segment + 11]);
+        } else if (is_frame_marker(marker) && length >= 8) {
+            info.precision = data[segment];
+            info.height = u8_to_u16(data[segment + 1], data[segment + 2]);
+            info.width = u8_to_u16(data[segment + 3], data[segment + 4]);
+            info.components_nbr = data[segment + 5];
+            info.frame_marker = marker;
+            info.progressive = marker == 0xc2 || marker == 0xc6 || marker == 0xca || marker == 0xce;
+            return info;
+        }
+        index = segment_end;
+    }
+    throw std::runtime_error("No frame header found");
+}
@@ -0,0 +1,29 @@
+#ifndef UNTITLED_PROBE_H
+#define UNTITLED_PROBE_H
+
+#include <span>
+
+#include "jpeg_parser.h"
+
+struct ImageInfo {
+    unsigned short width;
+    unsigned short height;
+    unsigned char components_nbr;
+    unsigned char precision;
+    // Start Of Frame marker (0xc0 for baseline, 0xc2 for progressive...)
+    unsigned char frame_marker;
+    bool progressive;
+    // JFIF fields, only meaningful if has_jfif
+    bool has_jfif;
+    JFIFVersion version;
+    DensityUnit density_unit;
+    unsigned short x_density;
+    unsigned short y_density;
+};
+
+// Reads the image dimensions and JFIF metadata, stopping at the frame header. Only the APP0 and SOF segments
+// are read, every other one (tables, thumbnails...) is skipped over using its length.
+// Throws std::runtime_error if the data is not a JPEG file or ends before the frame header.
+ImageInfo probe(std::span<const unsigned char> data);
+
+#endif //UNTITLED_PROBE_H
@@ -0,0 +1,631 @@
+#include "scan_decoder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MARKER_SSE2
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define MARKER_NEON
+#endif
+
+#include "utils.h"
+
+ScanDecoder::ScanDecoder(const FrameHeader &frame, const ScanHeader &scan,
+                         const std::array<HuffmanDecoder, 4> &dc_decoders,
+                         const std::array<HuffmanDecoder, 4> &ac_decoders, unsigned short restart_interval) noexcept:
+frame(frame), scan(scan), dc_decoders(dc_decoders), ac_decoders(ac_decoders), restart_interval(restart_interval),
+progressive(frame.progressive), current {{0, 0, 0, 0}, restart_interval, 0}, refill_count(0),
+range_decoder(select_range_decoder()) {}
+
+ScanDecoder::RangeDecoder ScanDecoder::select_range_decoder() const {
+    if (progressive) {
+        return &ScanDecoder::decode_range_generic;
+    }
+    if (scan.components_nbr == 1) {
+        return &ScanDecoder::decode_range<1, 1, 1>;
+    }
+    // Chroma with a single block per MCU, the luma first.
+    for (int i = 1; i < scan.components_nbr; i++) {
+        const FrameComponent &component = frame.components[scan.components[i].frame_index];
+        if (component.h != 1 || component.v != 1) {
+            return &ScanDecoder::decode_range_generic;
+        }
+    }
+    const FrameComponent &first = frame.components[scan.components[0].frame_index];
+    if (scan.components_nbr == 3) {
+        if (first.h == 1 && first.v == 1) {
+            return &ScanDecoder::decode_range<3, 1, 1>;
+        }
+        if (first.h == 2 && first.v == 1) {
+            return &ScanDecoder::decode_range<3, 2, 1>;
+        }
+        if (first.h == 2 && first.v == 2) {
+            return &ScanDecoder::decode_range<3, 2, 2>;
+        }
+    }
+    return &ScanDecoder::decode_range_generic;
+}
+
+
+int ScanDecoder::component_blocks_x(const FrameComponent &component) const {
+    int width = (frame.width * component.h + frame.h_max - 1) / frame.h_max;
+    return (width + 7) / 8;
+}
+
+int ScanDecoder::component_blocks_y(const FrameComponent &component) const {
+    int height = (frame.height * component.v + frame.v_max - 1) / frame.v_max;
+    return (height + 7) / 8;
+}
+
+int ScanDecoder::mcu_rows() const {
+    if (scan.components_nbr == 1) {
+        return component_blocks_y(frame.components[scan.components[0].frame_index]);
+    }
+    return frame.mcus_y();
+}
+
+int ScanDecoder::mcus_per_row() const {
+    if (scan.components_nbr == 1) {
+        return component_blocks_x(frame.components[scan.components[0].frame_index]);
+    }
+    return frame.mcus_x();
+}
+
+size_t ScanDecoder::decode(const unsigned char *data, size_t size, std::vector<ComponentCoefficients> &coefficients,
+                           ThreadPool *pool) {
+    if (restart_interval != 0 && pool != nullptr && pool->size() > 1) {
+        std::vector<std::pair<size_t, size_t>> intervals;
+        if (find_intervals(data, size, intervals)) {
+            refill_count = decode_intervals(data, intervals, coefficients, *pool);
+            return intervals.back().second;
+        }
+        // Missing or extra markers, the sequential decoding resynchronizes on the markers it finds.
+    }
+
+    BitReader reader {data, size};
+    int rows = mcu_rows();
+    for (int row = 0; row < rows; row++) {
+        decode_mcu_row(reader, row, coefficients);
+    }
+    refill_count = reader.refills();
+    return scan_end(reader, data, size);
+}
+
+void ScanDecoder::decode_region(const unsigned char *data, size_t size, const MCURegion &frame_region,
+                                std::vector<ComponentCoefficients> &coefficients, ThreadPool *pool,
+                                std::span<const ResumePoint> index) const {
+    // The MCUs of a non-interleaved scan are single blocks.
+    MCURegion region = frame_region;
+    if (scan.components_nbr == 1) {
+        const FrameComponent &component = frame.components[scan.components[0].frame_index];
+        region = MCURegion {region.x0 * component.h, region.y0 * component.v,
+                            std::min(region.x1 * component.h, mcus_per_row()),
+                            std::min(region.y1 * component.v, mcu_rows())};
+    }
+    int mcus_x = mcus_per_row();
+    int mcus = mcu_rows() * mcus_x;
+    int first_mcu = region.y0 * mcus_x + region.x0;
+    // MCU following the last one of the region.
+    int last_mcu = (region.y1 - 1) * mcus_x + region.x1;
+
+    std::vector<ResumePoint> intervals;
+    if (index.empty()) {
+        intervals = interval_points(data, size);
+        index = intervals;
+    }
+    ResumePoint start {0, BitReader {data, size}.state(), Checkpoint {{0, 0, 0, 0}, restart_interval, 0}};
+    auto point_before = [&](int mcu) {
+        auto next = std::upper_bound(index.begin(), index.end(), mcu,
+                                     [](int value, const ResumePoint &point) { return value < point.mcu; });
+        return next == index.begin() ? &start : &*(next - 1);
+    };
+
+    // Runs of MCUs decoded independently of each other, from a resume point up to an MCU (excluded).
+    std::vector<std::pair<const ResumePoint *, int>> runs;
+    if (restart_interval == 0 || index.empty()) {
+        runs.emplace_back(point_before(first_mcu), last_mcu);
+    } else {
+        for (int i = first_mcu / restart_interval; i * restart_interval < last_mcu; i++) {
+            int first = i * restart_interval;
+            int end = std::min(first + restart_interval, mcus);
+            // Whether one of the rows covered by the interval has columns of the region in it.
+            bool needed = false;
+            int last_row = std::min((end - 1) / mcus_x, region.y1 - 1);
+            for (int row = std::max(first / mcus_x, region.y0); row <= last_row && !needed; row++) {
+                int from = std::max(first - row * mcus_x, 0);
+                int to = std::min(end - row * mcus_x, mcus_x);
+                needed = from < region.x1 && to > region.x0;
+            }
+            if (!needed) {
+                continue;
+            }
+            const ResumePoint *point = point_before(std::max(first, first_mcu));
+            int stop = std::min(end, last_mcu);
+            // Without a point in this interval, the previous run goes on through it.
+            if (!runs.empty() && point->mcu < runs.back().second) {
+                runs.back().second = stop;
+            } else {
+                runs.emplace_back(point, stop);
+            }
+        }
+    }
+
+    auto decode_run = [&](size_t k) {
+        auto [point, stop] = runs[k];
+        BitReader reader {data, size};
+        reader.restore(point->reader);
+        Checkpoint run_state = point->decoder;
+        for (int mcu = point->mcu; mcu < stop; mcu++) {
+            next_mcu(reader, run_state);
+            decode_region_mcu(reader, mcu, region, run_state, coefficients);
+        }
+    };
+    if (pool != nullptr) {
+        pool->parallel_for(runs.size(), decode_run);
+    } else {
+        for (size_t k = 0; k < runs.size(); k++) {
+            decode_run(k);
+        }
+    }
+}
+
+std::vector<ScanDecoder::ResumePoint> ScanDecoder::resume_points(const unsigned char *data, size_t size) const {
+    std::vector<ResumePoint> points = interval_points(data, size);
+    if (!points.empty()) {
+        return points;
+    }
+
+    // Without usable markers, everything is decoded to know where each MCU row starts.
+    BitReader reader {data, size};
+    Checkpoint run_state {{0, 0, 0, 0}, restart_interval, 0};
+    int rows = mcu_rows();
+    int mcus_x = mcus_per_row();
+    for (int row = 0; row < rows; row++) {
+        points.push_back(ResumePoint {row * mcus_x, reader.state(), run_state});
+        for (int mx = 0; mx < mcus_x; mx++) {
+            next_mcu(reader, run_state);
+            skip_mcu(reader, run_state);
+        }
+    }
+    return points;
+}
+
+std::vector<ScanDecoder::ResumePoint> ScanDecoder::interval_points(const unsigned char *data, size_t size) const {
+    std::vector<ResumePoint> points;
+    std::vector<std::pair<size_t, size_t>> intervals;
+    if (restart_interval == 0 || !find_intervals(data, size, intervals)) {
+        return points;
+    }
+    for (size_t i = 0; i < intervals.size(); i++) {
+        BitReader::State reader {intervals[i].first, 0, 0, false, false};
+        points.push_back(ResumePoint {(int) i * restart_interval, reader,
+                                      Checkpoint {{0, 0, 0, 0}, restart_interval, 0}});
+    }
+    return points;
+}
+
+size_t ScanDecoder::scan_end(const BitReader &reader, const unsigned char *data, size_t size) {
+    if (reader.reached_marker()) {
+        return reader.position();
+    }
+    // The reader fetches at most 8 bytes ahead, or 16 when all of them are stuffed.
+    size_t from = reader.position() > 16 ? reader.position() - 16 : 0;
+    return find_marker(data, size, from);
+}
+
+bool ScanDecoder::find_intervals(const unsigned char *data, size_t size,
+                                 std::vector<std::pair<size_t, size_t>> &intervals) const {
+    // One pass over the bytes to find where each interval starts and ends, much faster than decoding them.
+    size_t start = 0;
+    while (true) {
+        size_t end = find_marker(data, size, start);
+        intervals.emplace_back(start, end);
+        size_t marker = end;
+        while (marker + 1 < size && data[marker + 1] == 0xff) {
+            marker += 1;
+        }
+        if (marker + 1 >= size || data[marker + 1] < 0xd0 || data[marker + 1] > 0xd7) {
+            break;
+        }
+        start = marker + 2;
+    }
+
+    long long mcus = (long long) mcu_rows() * mcus_per_row();
+    return (long long) intervals.size() == (mcus + restart_interval - 1) / restart_interval;
+}
+
+unsigned long long ScanDecoder::decode_intervals(const unsigned char *data,
+                                                 const std::vector<std::pair<size_t, size_t>> &intervals,
+                                                 std::vector<ComponentCoefficients> &coefficients,
+                                                 ThreadPool &pool) const {
+    int mcus_x = mcus_per_row();
+    int mcus = mcu_rows() * mcus_x;
+    std::atomic<unsigned long long> total_refills {0};
+    // Intervals write to distinct blocks, and the predictors (and end-of-band runs) are reset at each of them.
+    pool.parallel_for(intervals.size(), [&](size_t i) {
+        auto [start, end] = intervals[i];
+        BitReader reader {data + start, end - start};
+        // Counting down from a whole interval, no RSTn marker is expected before the end of the data.
+        Checkpoint interval_state {{0, 0, 0, 0}, restart_interval, 0};
+        int first = (int) i * restart_interval;
+        int last = std::min(first + restart_interval, mcus);
+        (this->*range_decoder)(reader, first, last, interval_state, coefficients);
+        total_refills += reader.refills();
+    });
+    return total_refills;
+}
+
+void ScanDecoder::next_mcu(BitReader &reader, Checkpoint &state) const {
+    if (restart_interval != 0) {
+        if (state.restart_countdown == 0) {
+            reader.restart();
+            state.predictors = {0, 0, 0, 0};
+            state.eob_run = 0;
+            state.restart_countdown = restart_interval;
+        }
+        state.restart_countdown -= 1;
+    }
+}
+
+void ScanDecoder::decode_mcu_row(BitReader &reader, int row, std::vector<ComponentCoefficients> &coefficients) {
+    int mcus_x = mcus_per_row();
+    (this->*range_decoder)(reader, row * mcus_x, (row + 1) * mcus_x, current, coefficients);
+}
+
+template <int Components, int H, int V>
+void ScanDecoder::decode_range(BitReader &reader, int first, int last, Checkpoint &state,
+                               std::vector<ComponentCoefficients> &coefficients) const {
+    std::array<const HuffmanDecoder *, Components> dc;
+    std::array<const HuffmanDecoder *, Components> ac;
+    std::array<ComponentCoefficients *, Components> outputs;
+    for (int i = 0; i < Components; i++) {
+        const ScanComponent &scan_component = scan.components[i];
+        dc[i] = &dc_decoders[scan_component.dc_table_id];
+        ac[i] = &ac_decoders[scan_component.ac_table_id];
+        outputs[i] = &coefficients[scan_component.frame_index];
+    }
+
+    int mcus_x = mcus_per_row();
+    int mx = first % mcus_x;
+    int row = first / mcus_x;
+    for (int mcu = first; mcu < last; mcu++) {
+        next_mcu(reader, state);
+        for (int v = 0; v < V; v++) {
+            for (int h = 0; h < H; h++) {
+                decode_block(reader, *dc[0], *ac[0], state.predictors[0], outputs[0]->block(mx * H + h, row * V + v));
+            }
+        }
+        for (int i = 1; i < Components; i++) {
+            decode_block(reader, *dc[i], *ac[i], state.predictors[i], outputs[i]->block(mx, row));
+        }
+        mx += 1;
+        if (mx == mcus_x) {
+            mx = 0;
+            row += 1;
+        }
+    }
+}
+
+void ScanDecoder::decode_range_generic(BitReader &reader, int first, int last, Checkpoint &state,
+                                       std::vector<ComponentCoefficients> &coefficients) const {
+    int mcus_x = mcus_per_row();
+    for (int mcu = first; mcu < last; mcu++) {
+        next_mcu(reader, state);
+        decode_mcu(reader, mcu % mcus_x, mcu / mcus_x, state, coefficients);
+    }
+}
+
+void ScanDecoder::decode_mcu(BitReader &reader, int mx, int row, Checkpoint &state,
+                             std::vector<ComponentCoefficients> &coefficients) const {
+    if (scan.components_nbr == 1) {
+        const ScanComponent &scan_component = scan.components[0];
+        const HuffmanDecoder &dc = dc_decoders[scan_component.dc_table_id];
+        const HuffmanDecoder &ac = ac_decoders[scan_component.ac_table_id];
+        short *block = coefficients[scan_component.frame_index].block(mx, row);
+        if (progressive) {
+            decode_progressive_block(reader, dc, ac, state, 0, block);
+        } else {
+            decode_block(reader, dc, ac, state.predictors[0], block);
+        }
+        return;
+    }
+
+    for (int i = 0; i < scan.components_nbr; i++) {
+        const ScanComponent &scan_component = scan.components[i];
+        const FrameComponent &component = frame.components[scan_component.frame_index];
+        const HuffmanDecoder &dc = dc_decoders[scan_component.dc_table_id];
+        const HuffmanDecoder &ac = ac_decoders[scan_component.ac_table_id];
+        ComponentCoefficients &component_coefficients = coefficients[scan_component.frame_index];
+
+        for (int v = 0; v < component.v; v++) {
+            for (int h = 0; h < component.h; h++) {
+                short *block = component_coefficients.block(mx * component.h + h, row * component.v + v);
+                if (progressive) {
+                    decode_progressive_block(reader, dc, ac, state, i, block);
+                } else {
+                    decode_block(reader, dc, ac, state.predictors[i], block);
+                }
+            }
+        }
+    }
+}
+
+void ScanDecoder::decode_region_mcu(BitReader &reader, int mcu, const MCURegion &region,
+                                    Checkpoint &state, std::vector<ComponentCoefficients> &coefficients) const {
+    int mcus_x = mcus_per_row();
+    int mx = mcu % mcus_x;
+    int row = mcu / mcus_x;
+    if (mx >= region.x0 && mx < region.x1 && row >= region.y0 && row < region.y1) {
+        decode_mcu(reader, mx - region.x0, row - region.y0, state, coefficients);
+    } else {
+        skip_mcu(reader, state);
+    }
+}
+
+void ScanDecoder::skip_mcu(BitReader &reader, Checkpoint &state) const {
+    // Still fully decoded, for the predictors and the position of the next MCU. Only used for sequential scans.
+    short block[64];
+    for (int i = 0; i < scan.components_nbr; i++) {
+        const ScanComponent &scan_component = scan.components[i];
+        const FrameComponent &component = frame.components[scan_component.frame_index];
+        const HuffmanDecoder &dc = dc_decoders[scan_component.dc_table_id];
+        const HuffmanDecoder &ac = ac_decoders[scan_component.ac_table_id];
+        int blocks = scan.components_nbr == 1 ? 1 : component.h * component.v;
+        for (int b = 0; b < blocks; b++) {
+            decode_block(reader, dc, ac, state.predictors[i], block);
+        }
+    }
+}
+
+void ScanDecoder::decode_block(BitReader &reader, const HuffmanDecoder &dc, const HuffmanDecoder &ac, int &predictor,
+                               short *block) const {
+    std::fill_n(block, 64, 0);
+
+    // A DC code and its magnitude take at most 16 + 11 bits.
+    reader.ensure(32);
+    HuffmanSymbol symbol = dc.decode(reader.peek(16));
+    if (symbol.length == 0 || symbol.value > 11) {
+        throw std::runtime_error("Invalid DC Huffman code");
+    }
+    reader.skip(symbol.length);
+    if (symbol.value != 0) {
+        predictor += reader.receive_extend(symbol.value);
+    }
+    block[0] = (short) predictor;
+
+    int k = 1;
+    while (k < 64) {
+        // An AC code and its magnitude take at most 16 + 10 bits.
+        reader.ensure(32);
+        unsigned int bits = reader.peek(16);
+
+        short fused = ac.fast_ac[bits >> (16 - HUFFMAN_FAST_BITS)];
+        if (fused != 0) {
+            k += (fused >> 4) & 0x0f;
+            reader.skip(fused & 0x0f);
+            if (k > 63) {
+                throw std::runtime_error("AC coefficient out of block");
+            }
+            block[ZIGZAG[k]] = (short) (fused >> 8);
+            k += 1;
+            continue;
+        }
+
+        symbol = ac.decode(bits);
+        if (symbol.length == 0) {
+            throw std::runtime_error("Invalid AC Huffman code");
+        }
+        reader.skip(symbol.length);
+        int run = symbol.value >> 4;
+        int size = symbol.value & 0x0f;
+        if (size == 0) {
+            if (run != 15) {
+                // End of block
+                break;
+            }
+            k += 16;
+            continue;
+        }
+        k += run;
+        if (k > 63) {
+            throw std::runtime_error("AC coefficient out of block");
+        }
+        block[ZIGZAG[k]] = (short) reader.receive_extend(size);
+        k += 1;
+    }
+}
+
+void ScanDecoder::decode_progressive_block(BitReader &reader, const HuffmanDecoder &dc, const HuffmanDecoder &ac,
+                                           Checkpoint &state, int index, short *block) const {
+    if (scan.spectral_start != 0) {
+        if (scan.approx_high == 0) {
+            decode_ac_first(reader, ac, state.eob_run, block);
+        } else {
+            decode_ac_refine(reader, ac, state.eob_run, block);
+        }
+        return;
+    }
+
+    if (scan.approx_high != 0) {
+        // One more bit of the DC coefficient
+        reader.ensure(1);
+        if (reader.peek(1) != 0) {
+            block[0] = (short) (block[0] | (1 << scan.approx_low));
+        }
+        reader.skip(1);
+        return;
+    }
+    reader.ensure(32);
+    HuffmanSymbol symbol = dc.decode(reader.peek(16));
+    if (symbol.length == 0 || symbol.value > 11) {
+        throw std::runtime_error("Invalid DC Huffman code");
+    }
+    reader.skip(symbol.length);
+    if (symbol.value != 0) {
+        state.predictors[index] += reader.receive_extend(symbol.value);
+    }
+    block[0] = (short) (state.predictors[index] * (1 << scan.approx_low));
+}
+
+void ScanDecoder::decode_ac_first(BitReader &reader, const HuffmanDecoder &ac, int &eob_run, short *block) const {
+    if (eob_run > 0) {
+        eob_run -= 1;
+        return;
+    }
+    int scale = 1 << scan.approx_low;
+    for (int k = scan.spectral_start; k <= scan.spectral_end; k++) {
+        reader.ensure(32);
+        unsigned int bits = reader.peek(16);
+
+        short fused = ac.fast_ac[bits >> (16 - HUFFMAN_FAST_BITS)];
+        if (fused != 0) {
+            k += (fused >> 4) & 0x0f;
+            reader.skip(fused & 0x0f);
+            if (k > scan.spectral_end) {
+                throw std::runtime_error("AC coefficient out of band");
+            }
+            block[ZIGZAG[k]] = (short) ((fused >> 8) * scale);
+            continue;
+        }
+
+        HuffmanSymbol symbol = ac.decode(bits);
+        if (symbol.length == 0) {
+            throw std::runtime_error("Invalid AC Huffman code");
+        }
+        reader.skip(symbol.length);
+        int run = symbol.value >> 4;
+        int size = symbol.value & 0x0f;
+        if (size == 0) {
+            if (run != 15) {
+                // End of band, for this block and the next 2^run - 1 + (run bits) ones.
+                eob_run = (1 << run) - 1;
+                if (run != 0) {
+                    eob_run += (int) reader.peek(run);
+                    reader.skip(run);
+                }
+                break;
+            }
+            k += 15;
+            continue;
+        }
+        k += run;
+        if (k > scan.spectral_end) {
+            throw std::runtime_error("AC coefficient out of band");
+        }
+        block[ZIGZAG[k]] = (short) (reader.receive_extend(size) * scale);
+    }
+}
+
+void ScanDecoder::decode_ac_refine(BitReader &reader, const HuffmanDecoder &ac, int &eob_run, short *block) const {
+    // Same algorithm as libjpeg: the new bit of the coefficients already non-zero comes along with the codes of
+    // the ones becoming non-zero, which can only be 1 or -1 at this bit position.
+    int positive = 1 << scan.approx_low;
+    int negative = -positive;
+    auto refine = [&](short &coefficient) {
+        reader.ensure(1);
+        if (reader.peek(1) != 0 && (coefficient & positive) == 0) {
+            coefficient = (short) (coefficient + (coefficient >= 0 ? positive : negative));
+        }
+        reader.skip(1);
+    };
+
+    int k = scan.spectral_start;
+    if (eob_run == 0) {
+        for (; k <= scan.spectral_end; k++) {
+            reader.ensure(32);
+            HuffmanSymbol symbol = ac.decode(reader.peek(16));
+            if (symbol.length == 0) {
+                throw std::runtime_error("Invalid AC Huffman code");
+            }
+            reader.skip(symbol.length);
+            int run = symbol.value >> 4;
+            int size = symbol.value & 0x0f;
+            int value = 0;
+            if (size != 0) {
+                if (size != 1) {
+                    throw std::runtime_error("Invalid AC refinement");
+                }
+                value = reader.peek(1) != 0 ? positive : negative;
+                reader.skip(1);
+            } else if (run != 15) {
+                eob_run = 1 << run;
+                if (run != 0) {
+                    eob_run += (int) reader.peek(run);
+                    reader.skip(run);
+                }
+                break;
+            }
+
+            // Skips `run` zero coefficients, refining the non-zero ones on the way.
+            for (; k <= scan.spectral_end; k++) {
+                short &coefficient = block[ZIGZAG[k]];
+                if (coefficient != 0) {
+                    refine(coefficient);
+                } else if (run == 0) {
+                    break;
+                } else {
+                    run -= 1;
+                }
+            }
+            if (value != 0) {
+                if (k > scan.spectral_end) {
+                    throw std::runtime_error("AC coefficient out of band");
+                }
+                block[ZIGZAG[k]] = (short) value;
+            }
+        }
+    }
+
+    if (eob_run > 0) {
+        // The rest of the band only has refinement bits.
+        for (; k <= scan.spectral_end; k++) {
+            short &coefficient = block[ZIGZAG[k]];
+            if (coefficient != 0) {
+                refine(coefficient);
+            }
+        }
+        eob_run -= 1;
+    }
+}
+
+
+size_t find_marker(const unsigned char *data, size_t size, size_t from) {
+    size_t i = from;
+    // 16 bytes at a time, compared along with the bytes following them: a marker is a 0xFF byte not followed
+    // by 0x00. Stuffed bytes are about one in a few hundred, so most blocks have no match at all.
+#if defined(MARKER_SSE2)
+    const __m128i ff = _mm_set1_epi8((char) 0xff);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 17 <= size; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (data + i));
+        __m128i next = _mm_loadu_si128((const __m128i *) (data + i + 1));
+        __m128i markers = _mm_andnot_si128(_mm_cmpeq_epi8(next, zero), _mm_cmpeq_epi8(bytes, ff));
+        auto mask = (unsigned int) _mm_movemask_epi8(markers);
+        if (mask != 0) {
+            return i + std::countr_zero(mask);
+        }
+    }
+#elif defined(MARKER_NEON)
+    for (; i + 17 <= size; i += 16) {
+        uint8x16_t bytes = vld1q_u8(data + i);
+        uint8x16_t next = vld1q_u8(data + i + 1);
+        uint8x16_t markers = vandq_u8(vceqq_u8(bytes, vdupq_n_u8(0xff)), vtstq_u8(next, next));
+        uint8x8_t any = vorr_u8(vget_low_u8(markers), vget_high_u8(markers));
+        // Found by the loop below.
+        if (vget_lane_u64(vreinterpret_u64_u8(any), 0) != 0) {
+            break;
+        }
+    }
+#endif
+    for (; i + 1 < size; i++) {
+        if (data[i] == 0xff && data[i + 1] != 0x00) {
+            return i;
+        }
+    }
+    return size;
+}
@@ -0,0 +1,146 @@
+#ifndef UNTITLED_SCAN_DECODER_H
+#define UNTITLED_SCAN_DECODER_H
+
+#include <array>
+#include <cstddef>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "bit_reader.h"
+#include "huffman.h"
+#include "jpeg_parser.h"
+#include "thread_pool.h"
+
+// Rectangle [x0, x1) x [y0, y1) of MCUs of the frame.
+struct MCURegion {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+};
+
+// Decodes the entropy-coded data of a Huffman scan into quantized coefficient blocks. Sequential scans decode
+// whole blocks, while the scans of progressive frames refine the blocks left by the previous ones: with a
+// band of coefficients (spectral selection) and/or their low bits (successive approximation).
+// With a restart interval, the data is split by RSTn markers into intervals that do not depend on each other,
+// which decode() spreads over the threads of a pool.
+class ScanDecoder {
+public:
+    // `restart_interval` is the number of MCUs between RSTn markers, as defined by DRI (0 for none).
+    ScanDecoder(const FrameHeader &frame, const ScanHeader &scan,
+                const std::array<HuffmanDecoder, 4> &dc_decoders,
+                const std::array<HuffmanDecoder, 4> &ac_decoders, unsigned short restart_interval = 0) noexcept;
+
+    // Decodes the whole scan starting at `data`. Returns the number of bytes of entropy-coded data, which is
+    // also the offset of the marker that ends the scan. Restart intervals are decoded in parallel on `pool`,
+    // if any, provided the RSTn markers are all where they should be.
+    size_t decode(const unsigned char *data, size_t size, std::vector<ComponentCoefficients> &coefficients,
+                  ThreadPool *pool = nullptr);
+    // BitReader refills of the last decode(), only counted when collecting stats (see decode_stats.h).
+    unsigned long long refills() const { return refill_count; }
+
+    // Saving this state along with a copy of the BitReader allows resuming at an MCU row boundary.
+    struct Checkpoint {
+        std::array<int, 4> predictors;
+        // MCUs left before the next RSTn marker.
+        int restart_countdown;
+        // Blocks left in the current end-of-band run, for the AC scans of progressive frames.
+        int eob_run;
+    };
+    Checkpoint checkpoint() const { return current; }
+    void restore(const Checkpoint &checkpoint) { current = checkpoint; }
+
+    // Where decoding can start without going through the data before, at MCU number `mcu` in scan order.
+    struct ResumePoint {
+        int mcu;
+        // Relative to the start of the scan data.
+        BitReader::State reader;
+        Checkpoint decoder;
+    };
+    // One point per restart interval, found with a scan for the markers, or else one per MCU row of the scan,
+    // which takes entropy decoding the whole scan. See ScanIndex.
+    std::vector<ResumePoint> resume_points(const unsigned char *data, size_t size) const;
+
+    // Decodes the MCUs of `region` (of the frame, not of the scan) into coefficients covering just the region,
+    // the MCU at (x0, y0) being stored at (0, 0). The MCUs before it still have to go through the Huffman
+    // decoder, but only from the closest resume point, and decoding stops after the region. Without `index`,
+    // the resume points are the restart intervals, if any, so all the MCU rows above the region are decoded
+    // when there are none. Runs of MCUs starting at different points are decoded in parallel on `pool`, if any.
+    void decode_region(const unsigned char *data, size_t size, const MCURegion &region,
+                       std::vector<ComponentCoefficients> &coefficients, ThreadPool *pool = nullptr,
+                       std::span<const ResumePoint> index = {}) const;
+
+    // Number of MCU rows in the scan. For a non-interleaved scan, an MCU is a single block.
+    int mcu_rows() const;
+    // Decodes the MCUs of a row, going through the RSTn markers met on the way.
+    void decode_mcu_row(BitReader &reader, int row, std::vector<ComponentCoefficients> &coefficients);
+
+    // Offset of the marker ending the scan, once all its MCU rows went through `reader`.
+    static size_t scan_end(const BitReader &reader, const unsigned char *data, size_t size);
+
+private:
+    const FrameHeader &frame;
+    const ScanHeader &scan;
+    const std::array<HuffmanDecoder, 4> &dc_decoders;
+    const std::array<HuffmanDecoder, 4> &ac_decoders;
+    unsigned short restart_interval;
+    bool progressive;
+    // State of decode_mcu_row() from one call to the next.
+    Checkpoint current;
+    unsigned long long refill_count;
+    // Decodes MCUs [first, last) of the scan, going through the RSTn markers due on the way. Chosen once for the
+    // scan among the decode_range() instances, see select_range_decoder().
+    using RangeDecoder = void (ScanDecoder::*)(BitReader &reader, int first, int last, Checkpoint &state,
+                                              std::vector<ComponentCoefficients> &coefficients) const;
+    RangeDecoder range_decoder;
+
+    // Size in blocks of the (unpadded) part of a component covered by a non-interleaved scan.
+    int component_blocks_x(const FrameComponent &component) const;
+    int component_blocks_y(const FrameComponent &component) const;
+    int mcus_per_row() const;
+
+    // Fills `intervals` with the offsets of the first byte of each restart interval and of the marker ending it.
+    // Returns whether there are as many as the scan should have.
+    bool find_intervals(const unsigned char *data, size_t size,
+                        std::vector<std::pair<size_t, size_t>> &intervals) const;
+    // Resume points at the start of each restart interval, none if the markers are not all there.
+    std::vector<ResumePoint> interval_points(const unsigned char *data, size_t size) const;
+    // Decodes the restart intervals of the scan on different threads, given the offsets of their first byte and
+    // of the marker ending them. Returns the number of BitReader refills.
+    unsigned long long decode_intervals(const unsigned char *data, const std::vector<std::pair<size_t, size_t>> &intervals,
+                          std::vector<ComponentCoefficients> &coefficients, ThreadPool &pool) const;
+    RangeDecoder select_range_decoder() const;
+    // For the sequential scans of the usual layouts: `Components` components, the first one with HxV blocks per
+    // MCU and the others with a single one (e.g. 3, 2, 2 for 4:2:0, or 1, 1, 1 for non-interleaved scans). The
+    // loops over the blocks of the MCU are then unrolled, with no test on the sampling factors.
+    template <int Components, int H, int V>
+    void decode_range(BitReader &reader, int first, int last, Checkpoint &state,
+                      std::vector<ComponentCoefficients> &coefficients) const;
+    // Any other scan, one decode_mcu() call per MCU.
+    void decode_range_generic(BitReader &reader, int first, int last, Checkpoint &state,
+                              std::vector<ComponentCoefficients> &coefficients) const;
+    // Decodes the MCU at column `mx` of MCU row `row`, which does not involve RSTn markers.
+    void decode_mcu(BitReader &reader, int mx, int row, Checkpoint &state,
+                    std::vector<ComponentCoefficients> &coefficients) const;
+    // Goes through the RSTn marker due before the next MCU, if any.
+    void next_mcu(BitReader &reader, Checkpoint &state) const;
+    // Decodes MCU number `mcu` of the scan into `coefficients` if it is in `region` (of the scan), and to a
+    // scratch block otherwise.
+    void decode_region_mcu(BitReader &reader, int mcu, const MCURegion &region, Checkpoint &state,
+                           std::vector<ComponentCoefficients> &coefficients) const;
+    void skip_mcu(BitReader &reader, Checkpoint &state) const;
+    void decode_block(BitReader &reader, const HuffmanDecoder &dc, const HuffmanDecoder &ac, int &predictor,
+                      short *block) const;
+    // Decodes the part of the block covered by a progressive scan, for component `index` of the scan.
+    void decode_progressive_block(BitReader &reader, const HuffmanDecoder &dc, const HuffmanDecoder &ac,
+                                  Checkpoint &state, int index, short *block) const;
+    void decode_ac_first(BitReader &reader, const HuffmanDecoder &ac, int &eob_run, short *block) const;
+    void decode_ac_refine(BitReader &reader, const HuffmanDecoder &ac, int &eob_run, short *block) const;
+};
+
+// Returns the offset of the first marker in `data`, starting at `from` (or `size` if there is none).
+// Stuffed 0xFF00 bytes are skipped; fill 0xFF bytes are considered part of the marker.
+size_t find_marker(const unsigned char *data, size_t size, size_t from);
+
+#endif //UNTITLED_SCAN_DECODER_H
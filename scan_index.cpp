@@ -0,0 +1,103 @@
+#include "scan_index.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "jpeg_parser.h"
+
+namespace {
+
+constexpr unsigned char MAGIC[4] = {'J', 'S', 'I', 'X'};
+constexpr unsigned char VERSION = 1;
+// Magic, version, file size, scan offset and number of points.
+constexpr size_t HEADER_SIZE = 4 + 1 + 8 + 8 + 4;
+// MCU, reader position, buffer, bit count and flags, restart countdown and predictors.
+constexpr size_t POINT_SIZE = 4 + 8 + 8 + 1 + 1 + 2 + 4 * 4;
+
+void put(std::vector<unsigned char> &output, unsigned long long value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        output.push_back((unsigned char) (value >> (8 * i)));
+    }
+}
+
+unsigned long long get(std::span<const unsigned char> data, size_t &offset, int bytes) {
+    unsigned long long value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (unsigned long long) data[offset + i] << (8 * i);
+    }
+    offset += bytes;
+    return value;
+}
+
+}
+
+ScanIndex ScanIndex::build(std::span<const unsigned char> data) {
+    JPEGParser parser {data};
+    JPEGEncoded encoded {};
+    ScanHeader scan {};
+    parser.parse_until_scan(encoded, scan);
+    if (encoded.frame.progressive || scan.components_nbr != encoded.frame.components_nbr) {
+        throw std::runtime_error("Only single scan files can be indexed");
+    }
+
+    ScanDecoder decoder {encoded.frame, scan, parser.dc_tables(), parser.ac_tables(), encoded.restart_interval};
+    size_t offset = parser.position();
+    return ScanIndex {data.size(), offset, decoder.resume_points(data.data() + offset, data.size() - offset)};
+}
+
+std::vector<unsigned char> ScanIndex::serialize() const {
+    std::vector<unsigned char> output(MAGIC, MAGIC + 4);
+    output.reserve(HEADER_SIZE + points.size() * POINT_SIZE);
+    put(output, VERSION, 1);
+    put(output, file_size, 8);
+    put(output, scan_offset, 8);
+    put(output, points.size(), 4);
+    for (const ScanDecoder::ResumePoint &point: points) {
+        put(output, (unsigned int) point.mcu, 4);
+        put(output, point.reader.pos, 8);
+        put(output, point.reader.buffer, 8);
+        put(output, (unsigned int) point.reader.bits, 1);
+        put(output, (point.reader.marker_reached ? 1 : 0) | (point.reader.end_reached ? 2 : 0), 1);
+        put(output, (unsigned int) point.decoder.restart_countdown, 2);
+        for (int predictor: point.decoder.predictors) {
+            put(output, (unsigned int) predictor, 4);
+        }
+    }
+    return output;
+}
+
+ScanIndex ScanIndex::deserialize(std::span<const unsigned char> data) {
+    if (data.size() < HEADER_SIZE || !std::equal(MAGIC, MAGIC + 4, data.begin()) || data[4] != VERSION) {
+        throw std::runtime_error("Invalid scan index");
+    }
+    size_t offset = 5;
+    ScanIndex index {};
+    index.file_size = get(data, offset, 8);
+    index.scan_offset = get(data, offset, 8);
+    size_t count = get(data, offset, 4);
+    if (count == 0 || data.size() != HEADER_SIZE + count * POINT_SIZE || index.scan_offset > index.file_size) {
+        throw std::runtime_error("Invalid scan index");
+    }
+
+    index.points.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        ScanDecoder::ResumePoint &point = index.points[i];
+        point.mcu = (int) get(data, offset, 4);
+        point.reader.pos = get(data, offset, 8);
+        point.reader.buffer = get(data, offset, 8);
+        point.reader.bits = (int) get(data, offset, 1);
+        unsigned int flags = get(data, offset, 1);
+        point.reader.marker_reached = (flags & 1) != 0;
+        point.reader.end_reached = (flags & 2) != 0;
+        point.decoder.restart_countdown = (int) get(data, offset, 2);
+        for (int &predictor: point.decoder.predictors) {
+            predictor = (int) (unsigned int) get(data, offset, 4);
+        }
+        // The points are used to read the file without further checks.
+        bool ordered = i == 0 ? point.mcu == 0 : point.mcu > index.points[i - 1].mcu;
+        if (!ordered || point.reader.pos > index.file_size - index.scan_offset || point.reader.bits > 64) {
+            throw std::runtime_error("Invalid scan index");
+        }
+    }
+    return index;
+}
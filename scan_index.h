@@ -0,0 +1,37 @@
+#ifndef UNTITLED_SCAN_INDEX_H
+#define UNTITLED_SCAN_INDEX_H
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "scan_decoder.h"
+
+// Positions in the entropy-coded data of a file where decoding can resume, so that decode_region() can jump
+// close to the rows it needs instead of decoding everything above them. Building the index takes a scan for
+// the RSTn markers with restart intervals, and a full entropy decode without them. It is meant to be built
+// once and saved along with the file, for the next requests on the same file.
+//
+//     ScanIndex index = ScanIndex::build(file);
+//     save(index.serialize());
+//     ...
+//     ScanIndex index = ScanIndex::deserialize(saved);
+//     Image tile = decode_region(file, region, PixelFormat::RGB, Upsampling::Fancy, Scale::Full, &index);
+struct ScanIndex {
+    // Size of the file and offset of the scan data in it, to check the index is used with the right file.
+    size_t file_size;
+    size_t scan_offset;
+    // Sorted by MCU, the first one being MCU 0.
+    std::vector<ScanDecoder::ResumePoint> points;
+
+    // Only files made of a single scan (with all the components) are supported, as usual for baseline.
+    // Throws std::runtime_error otherwise.
+    static ScanIndex build(std::span<const unsigned char> data);
+
+    // Compact and portable (little-endian) binary form.
+    std::vector<unsigned char> serialize() const;
+    // Throws std::runtime_error if `data` is not a valid index.
+    static ScanIndex deserialize(std::span<const unsigned char> data);
+};
+
+#endif //UNTITLED_SCAN_INDEX_H
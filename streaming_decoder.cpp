@@ -0,0 +1,190 @@
+#include "streaming_decoder.h"
+
+#include <stdexcept>
+
+StreamingDecoder::StreamingDecoder(PixelFormat format, Upsampling upsampling):
+format(format), upsampling(upsampling), input_finished(false), state(State::Segments),
+parser(std::span<const unsigned char> {}), headers(), scan(), headers_reported(false),
+scan_start(0), scan_row(0), scan_searched(0), incremental(true), output(), transformed_rows(0), ready_rows(0) {}
+
+void StreamingDecoder::feed(std::span<const unsigned char> data) {
+    buffer.insert(buffer.end(), data.begin(), data.end());
+}
+
+void StreamingDecoder::finish() {
+    input_finished = true;
+}
+
+StreamEvent StreamingDecoder::next() {
+    // The buffer may have been reallocated by feed()
+    parser.set_data(buffer);
+    if (reader) {
+        reader->rebase(buffer.data() + scan_start, buffer.size() - scan_start);
+    }
+
+    switch (state) {
+        case State::Segments:
+            return decode_segments();
+        case State::Scan:
+        case State::ScanEnd:
+            return decode_scan();
+        case State::Done:
+            break;
+    }
+    return StreamEvent::Finished;
+}
+
+StreamEvent StreamingDecoder::decode_segments() {
+    while (true) {
+        unsigned char marker = parser.parse_segment(headers, scan);
+        if (marker == 0) {
+            if (!input_finished) {
+                return StreamEvent::NeedMoreData;
+            }
+            marker = 0xd9;
+        }
+
+        if (marker == 0xd9) {
+            if (renderer) {
+                render_all();
+            }
+            state = State::Done;
+            return StreamEvent::Finished;
+        }
+
+        if (is_supported_frame(marker)) {
+            headers.allocate_coefficients();
+            const FrameHeader &frame = headers.frame;
+            output = Image {frame.width, frame.height, format,
+                            std::vector<unsigned char>((size_t) frame.width * frame.height * bytes_per_pixel(format))};
+            renderer.reset();
+            transformed_rows = 0;
+            ready_rows = 0;
+        }
+
+        if (marker == 0xda) {
+            if (!renderer) {
+                renderer.emplace(headers.frame, headers.q_tables, format, upsampling);
+            }
+            // A frame with a single component has a single block per MCU, whatever its sampling factors.
+            incremental = incremental && !headers.frame.progressive &&
+                          scan.components_nbr == headers.frame.components_nbr;
+            scan_decoder.emplace(headers.frame, scan, parser.dc_tables(), parser.ac_tables(), headers.restart_interval);
+            scan_start = parser.position();
+            reader.emplace(buffer.data() + scan_start, buffer.size() - scan_start);
+            scan_row = 0;
+            scan_searched = 0;
+            state = State::Scan;
+            if (!headers_reported) {
+                headers_reported = true;
+                return StreamEvent::HeadersReady;
+            }
+            return decode_scan();
+        }
+    }
+}
+
+StreamEvent StreamingDecoder::decode_scan() {
+    if (headers.frame.progressive) {
+        return decode_whole_scan();
+    }
+    int previously_ready = ready_rows;
+    int rows = scan_decoder->mcu_rows();
+    const FrameHeader &frame = headers.frame;
+    // Number of block rows of the component in each MCU row, for non-interleaved scans of 1 component frames.
+    int blocks_per_mcu_row = frame.components_nbr == 1 ? frame.components[0].v : 1;
+
+    while (state == State::Scan && scan_row < rows) {
+        BitReader checkpoint = *reader;
+        ScanDecoder::Checkpoint state = scan_decoder->checkpoint();
+        try {
+            scan_decoder->decode_mcu_row(*reader, scan_row, headers.coefficients);
+        } catch (const std::runtime_error &) {
+            // Made up zero bits may well be invalid codes
+            if (!reader->reached_end() || input_finished) {
+                throw;
+            }
+        }
+        if (reader->reached_end() && !input_finished) {
+            *reader = checkpoint;
+            scan_decoder->restore(state);
+            break;
+        }
+        scan_row += 1;
+        if (incremental) {
+            render_until(scan_row / blocks_per_mcu_row);
+        }
+    }
+    if (scan_row == rows) {
+        state = State::ScanEnd;
+    }
+
+    if (state == State::ScanEnd) {
+        const unsigned char *data = buffer.data() + scan_start;
+        size_t size = buffer.size() - scan_start;
+        size_t end = ScanDecoder::scan_end(*reader, data, size);
+        if (end < size || input_finished) {
+            parser.advance(end);
+            reader.reset();
+            state = State::Segments;
+            if (ready_rows == previously_ready) {
+                return decode_segments();
+            }
+        }
+    }
+
+    return ready_rows > previously_ready ? StreamEvent::RowsReady : StreamEvent::NeedMoreData;
+}
+
+StreamEvent StreamingDecoder::decode_whole_scan() {
+    const unsigned char *data = buffer.data() + scan_start;
+    size_t size = buffer.size() - scan_start;
+    // Looks for the marker ending the scan, going through the RSTn ones.
+    while (true) {
+        size_t found = find_marker(data, size, scan_searched);
+        size_t marker = found;
+        while (marker + 1 < size && data[marker + 1] == 0xff) {
+            marker += 1;
+        }
+        if (marker + 1 >= size) {
+            if (!input_finished) {
+                // The search resumes with the bytes that may start a marker.
+                scan_searched = found == size && size > 0 ? size - 1 : found;
+                return StreamEvent::NeedMoreData;
+            }
+            break;
+        }
+        if (data[marker + 1] < 0xd0 || data[marker + 1] > 0xd7) {
+            break;
+        }
+        scan_searched = marker + 2;
+    }
+
+    parser.advance(scan_decoder->decode(data, size, headers.coefficients));
+    reader.reset();
+    state = State::Segments;
+    return decode_segments();
+}
+
+void StreamingDecoder::render_until(int mcu_rows) {
+    size_t row_size = (size_t) output.width * bytes_per_pixel(format);
+    while (transformed_rows < mcu_rows) {
+        renderer->transform(headers.coefficients, transformed_rows);
+        // The fancy upsampling of an MCU row reads the first row of the next one
+        if (transformed_rows > 0) {
+            renderer->convert(transformed_rows - 1, output.pixels.data(), row_size);
+            ready_rows = renderer->end_row(transformed_rows - 1);
+        }
+        transformed_rows += 1;
+    }
+}
+
+void StreamingDecoder::render_all() {
+    int mcus_y = headers.frame.mcus_y();
+    if (ready_rows == output.height) {
+        return;
+    }
+    render_until(mcus_y);
+    renderer->convert(mcus_y - 1, output.pixels.data(), (size_t) output.width * bytes_per_pixel(format));
+    ready_rows = output.height;
+}
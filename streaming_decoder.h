@@ -0,0 +1,88 @@
+#ifndef UNTITLED_STREAMING_DECODER_H
+#define UNTITLED_STREAMING_DECODER_H
+
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "bit_reader.h"
+#include "decoder.h"
+#include "jpeg_parser.h"
+#include "scan_decoder.h"
+
+enum class StreamEvent {
+    // Everything fed so far has been used, feed() more (or finish()).
+    NeedMoreData,
+    // The frame header and the tables of the first scan are known, see encoded().
+    HeadersReady,
+    // More rows of image() are final, see rows_ready().
+    RowsReady,
+    // The end of the image (or of the data, after finish()) was reached.
+    Finished,
+};
+
+// Push-style decoder for data arriving in chunks, e.g. from the network. Data is decoded as soon as it is
+// available: marker segments once they are complete, and sequential scans one MCU row at a time. An MCU row
+// needing bytes that have not been received yet is retried from its start on the next call. The scans of
+// progressive frames are decoded once complete, and the image is only rendered at the end.
+//
+//     StreamingDecoder decoder;
+//     decoder.feed(chunk);
+//     while ((event = decoder.next()) != StreamEvent::NeedMoreData) { ... }
+class StreamingDecoder {
+public:
+    explicit StreamingDecoder(PixelFormat format = PixelFormat::RGB, Upsampling upsampling = Upsampling::Fancy);
+    StreamingDecoder(const StreamingDecoder &) = delete;
+    StreamingDecoder &operator=(const StreamingDecoder &) = delete;
+
+    // Appends the next bytes of the file. They are copied, so the caller can reuse its buffer.
+    void feed(std::span<const unsigned char> data);
+    // No more data will be fed: whatever is missing is decoded as zero bits.
+    void finish();
+    // Makes as much progress as possible with the data fed so far, and returns the first event that happens.
+    StreamEvent next();
+
+    const JPEGEncoded &encoded() const { return headers; }
+    // Rows [0, rows_ready()) of the image are final.
+    const Image &image() const { return output; }
+    int rows_ready() const { return ready_rows; }
+
+private:
+    enum class State {Segments, Scan, ScanEnd, Done};
+
+    PixelFormat format;
+    Upsampling upsampling;
+    std::vector<unsigned char> buffer;
+    bool input_finished;
+    State state;
+
+    JPEGParser parser;
+    JPEGEncoded headers;
+    ScanHeader scan;
+    bool headers_reported;
+
+    std::optional<ScanDecoder> scan_decoder;
+    std::optional<BitReader> reader;
+    size_t scan_start;
+    int scan_row;
+    // Offset of the scan data up to which there is no marker ending it, for progressive scans.
+    size_t scan_searched;
+    // Whether rows can be rendered while scans are decoded, which needs each scan to contain all the components.
+    bool incremental;
+
+    std::optional<MCURowRenderer> renderer;
+    Image output;
+    int transformed_rows;
+    int ready_rows;
+
+    StreamEvent decode_segments();
+    StreamEvent decode_scan();
+    // Progressive scans refine the coefficients left by the previous ones, so unlike sequential scans, they
+    // cannot be retried from the start of an MCU row. They are decoded at once, when all their data is there.
+    StreamEvent decode_whole_scan();
+    // Renders the MCU rows up to `mcu_rows` (excluded), whose coefficients are complete.
+    void render_until(int mcu_rows);
+    void render_all();
+};
+
+#endif //UNTITLED_STREAMING_DECODER_H
@@ -0,0 +1,90 @@
+#include "table_cache.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <mutex>
+
+namespace {
+
+// Multiplicative hash of 8 bytes at a time, plenty for a few hundred tables whose bytes are compared anyway.
+unsigned long long hash_bytes(std::span<const unsigned char> data, unsigned long long seed) {
+    unsigned long long hash = seed ^ (data.size() * 0x9e3779b97f4a7c15ULL);
+    size_t i = 0;
+    for (; i + 8 <= data.size(); i += 8) {
+        unsigned long long word;
+        std::memcpy(&word, data.data() + i, 8);
+        hash = (hash ^ word) * 0x100000001b3ULL;
+        hash ^= hash >> 29;
+    }
+    for (; i < data.size(); i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+bool same_bytes(const std::vector<unsigned char> &stored, std::span<const unsigned char> data) {
+    return std::equal(stored.begin(), stored.end(), data.begin(), data.end());
+}
+
+}
+
+void TableCache::huffman(std::span<const unsigned char> data, HuffmanTable &table, HuffmanDecoder &decoder) {
+    unsigned long long key = hash_bytes(data, 0);
+    {
+        std::shared_lock<std::shared_mutex> lock {mutex};
+        auto found = huffman_tables.find(key);
+        if (found != huffman_tables.end() && same_bytes(found->second.data, data)) {
+            table = found->second.table;
+            decoder = found->second.decoder;
+            return;
+        }
+    }
+
+    // Built without the lock, another thread may do the same meanwhile, in which case the first one is kept.
+    std::array<unsigned char, 16> size_data {};
+    std::copy(data.begin(), data.begin() + 16, size_data.begin());
+    table = HuffmanTable::from_size_data(size_data, data.subspan(16));
+    decoder = HuffmanDecoder::from_table(table);
+
+    std::unique_lock<std::shared_mutex> lock {mutex};
+    if (huffman_tables.size() >= capacity) {
+        huffman_tables.clear();
+    }
+    huffman_tables.try_emplace(key, HuffmanEntry {{data.begin(), data.end()}, table, decoder});
+}
+
+QuantizationTable TableCache::quantization(std::span<const unsigned char> data, unsigned char precision) {
+    unsigned long long key = hash_bytes(data, precision + 1);
+    {
+        std::shared_lock<std::shared_mutex> lock {mutex};
+        auto found = quantization_tables.find(key);
+        if (found != quantization_tables.end() && same_bytes(found->second.data, data)) {
+            return found->second.table;
+        }
+    }
+
+    std::array<unsigned short, 64> values {};
+    for (int k = 0; k < 64; k++) {
+        values[k] = precision == 0 ? data[k] : (unsigned short) ((data[2 * k] << 8) | data[2 * k + 1]);
+    }
+    QuantizationTable table = QuantizationTable::from_data(values);
+
+    std::unique_lock<std::shared_mutex> lock {mutex};
+    if (quantization_tables.size() >= capacity) {
+        quantization_tables.clear();
+    }
+    quantization_tables.try_emplace(key, QuantizationEntry {{data.begin(), data.end()}, table});
+    return table;
+}
+
+void TableCache::clear() {
+    std::unique_lock<std::shared_mutex> lock {mutex};
+    huffman_tables.clear();
+    quantization_tables.clear();
+}
+
+TableCache &TableCache::shared() {
+    static TableCache cache;
+    return cache;
+}
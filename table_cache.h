@@ -0,0 +1,48 @@
+#ifndef UNTITLED_TABLE_CACHE_H
+#define UNTITLED_TABLE_CACHE_H
+
+#include <cstddef>
+#include <shared_mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "huffman.h"
+#include "jpeg_parser.h"
+
+// Tables built from the content of DQT and DHT segments, reused from one file to the next: files from the same
+// camera or encoder share their tables, which are then only built once. Entries are keyed by a hash of the
+// table bytes, which are also compared on a hit, so a hash collision only means building the table anew.
+// Safe to use from any number of threads, lookups only taking a shared lock.
+class TableCache {
+public:
+    // Sets `table` and `decoder` to those of `data`, the 16 code counts followed by the values of a DHT table.
+    void huffman(std::span<const unsigned char> data, HuffmanTable &table, HuffmanDecoder &decoder);
+    // `data` holds the 64 values of a DQT table, each on 2 bytes for `precision` 1.
+    QuantizationTable quantization(std::span<const unsigned char> data, unsigned char precision);
+
+    // Number of tables of each kind kept at most. Once reached, the tables of that kind are all dropped, so
+    // files with ever different tables cannot make the cache grow without bounds.
+    static constexpr size_t capacity = 256;
+    void clear();
+
+    // Cache used by every JPEGParser by default.
+    static TableCache &shared();
+
+private:
+    struct HuffmanEntry {
+        std::vector<unsigned char> data;
+        HuffmanTable table;
+        HuffmanDecoder decoder;
+    };
+    struct QuantizationEntry {
+        std::vector<unsigned char> data;
+        QuantizationTable table;
+    };
+
+    std::shared_mutex mutex;
+    std::unordered_map<unsigned long long, HuffmanEntry> huffman_tables;
+    std::unordered_map<unsigned long long, QuantizationEntry> quantization_tables;
+};
+
+#endif //UNTITLED_TABLE_CACHE_H
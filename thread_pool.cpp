@@ -0,0 +1,183 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace {
+
+// Pool and queue of the worker running on the current thread, if any.
+thread_local const ThreadPool *current_pool = nullptr;
+thread_local size_t current_index = 0;
+
+}
+
+ThreadPool::ThreadPool(unsigned threads): queued(0), detached_loops(0), stopping(false) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (unsigned i = 1; i < threads; i++) {
+        workers.emplace_back([this, i] { work(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock<std::mutex> lock {sleep_mutex};
+        changed.wait(lock, [this] { return detached_loops.load() == 0; });
+        stopping = true;
+    }
+    changed.notify_all();
+    for (std::thread &worker: workers) {
+        worker.join();
+    }
+}
+
+ThreadPool &ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t)> &function) {
+    if (count == 0) {
+        return;
+    }
+    if (workers.empty() || count == 1) {
+        for (size_t i = 0; i < count; i++) {
+            function(i);
+        }
+        return;
+    }
+
+    Loop loop;
+    loop.function = function;
+    loop.remaining = count;
+    loop.detached = false;
+    size_t queue = current_queue();
+    push(queue, Task {&loop, 0, count});
+
+    Task task {};
+    while (loop.remaining.load() != 0) {
+        if (pop(queue, task)) {
+            run(queue, task);
+            continue;
+        }
+        // The other iterations are running on other threads
+        std::unique_lock<std::mutex> lock {sleep_mutex};
+        changed.wait(lock, [&] { return loop.remaining.load() == 0 || queued.load() != 0; });
+    }
+    if (loop.error) {
+        std::rethrow_exception(loop.error);
+    }
+}
+
+void ThreadPool::run_async(size_t count, std::function<void(size_t)> function) {
+    if (workers.empty()) {
+        for (size_t i = 0; i < count; i++) {
+            try {
+                function(i);
+            } catch (...) {
+            }
+        }
+        return;
+    }
+    if (count == 0) {
+        return;
+    }
+
+    Loop *loop = new Loop;
+    loop->function = std::move(function);
+    loop->remaining = count;
+    loop->detached = true;
+    detached_loops += 1;
+    push(current_queue(), Task {loop, 0, count});
+}
+
+size_t ThreadPool::current_queue() const {
+    return current_pool == this ? current_index : 0;
+}
+
+void ThreadPool::work(size_t queue) {
+    current_pool = this;
+    current_index = queue;
+    Task task {};
+    while (true) {
+        if (pop(queue, task)) {
+            run(queue, task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock {sleep_mutex};
+        changed.wait(lock, [this] { return stopping || queued.load() != 0; });
+        if (stopping && queued.load() == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::push(size_t queue, const Task &task) {
+    {
+        std::lock_guard<std::mutex> lock {queues[queue]->mutex};
+        queues[queue]->tasks.push_back(task);
+        queued += 1;
+    }
+    // Taking the lock makes sure a thread about to sleep sees the task or gets the notification.
+    {
+        std::lock_guard<std::mutex> lock {sleep_mutex};
+    }
+    changed.notify_one();
+}
+
+bool ThreadPool::pop(size_t queue, Task &task) {
+    if (queued.load() == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < queues.size(); i++) {
+        Queue &candidate = *queues[(queue + i) % queues.size()];
+        std::lock_guard<std::mutex> lock {candidate.mutex};
+        if (candidate.tasks.empty()) {
+            continue;
+        }
+        // The owner takes the latest (smallest) range, thieves the oldest (largest) one.
+        if (i == 0) {
+            task = candidate.tasks.back();
+            candidate.tasks.pop_back();
+        } else {
+            task = candidate.tasks.front();
+            candidate.tasks.pop_front();
+        }
+        queued -= 1;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::run(size_t queue, Task task) {
+    while (task.end - task.begin > 1) {
+        size_t middle = task.begin + (task.end - task.begin) / 2;
+        push(queue, Task {task.loop, middle, task.end});
+        task.end = middle;
+    }
+
+    Loop *loop = task.loop;
+    try {
+        loop->function(task.begin);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock {loop->error_mutex};
+        if (!loop->error) {
+            loop->error = std::current_exception();
+        }
+    }
+
+    if (loop->remaining.fetch_sub(1) == 1) {
+        // The owner of an attached loop may destroy it as soon as `remaining` is 0, it is not touched anymore.
+        if (loop->detached) {
+            delete loop;
+            detached_loops -= 1;
+        }
+        {
+            std::lock_guard<std::mutex> lock {sleep_mutex};
+        }
+        changed.notify_all();
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef UNTITLED_THREAD_POOL_H
+#define UNTITLED_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running the iterations of parallel loops, with work stealing.
+// Each thread has its own queue of ranges of iterations. A thread about to run a range pushes its upper half
+// back to its queue until a single iteration is left, so idle threads steal large chunks from the other end
+// of the queues while the owner keeps working on nearby iterations.
+// Threads waiting for a loop run queued work meanwhile, so loops can be nested (e.g. one iteration per image,
+// each running a loop per restart interval).
+class ThreadPool {
+public:
+    // Total number of threads running loops, the calling one included. 0 means one per hardware thread, while
+    // 1 starts no thread at all and runs every loop on the calling thread.
+    explicit ThreadPool(unsigned threads = 0);
+    // Waits for the loops started by run_async().
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned size() const { return (unsigned) workers.size() + 1; }
+
+    // Runs `function(i)` for every i in [0, count), in no particular order, and returns once all are done.
+    // If iterations throw, the other ones still run and the first exception is rethrown.
+    void parallel_for(size_t count, const std::function<void(size_t)> &function);
+    // Same, but returns immediately. Exceptions thrown by `function` are ignored, it should handle them itself.
+    void run_async(size_t count, std::function<void(size_t)> function);
+
+    // Pool shared by the whole process, with one thread per hardware thread. Started on first use.
+    static ThreadPool &shared();
+
+private:
+    struct Loop {
+        std::function<void(size_t)> function;
+        // Iterations not completed yet.
+        std::atomic<size_t> remaining;
+        std::mutex error_mutex;
+        std::exception_ptr error;
+        // Whether the loop belongs to the pool, which deletes it once completed (see run_async()).
+        bool detached;
+    };
+    struct Task {
+        Loop *loop;
+        size_t begin;
+        size_t end;
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::thread> workers;
+    // Queue i + 1 belongs to worker i, queue 0 is shared by the threads outside of the pool.
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::atomic<size_t> queued;
+    std::atomic<size_t> detached_loops;
+    std::mutex sleep_mutex;
+    // Signaled when tasks are queued and loops completed, and when stopping.
+    std::condition_variable changed;
+    bool stopping;
+
+    void work(size_t queue);
+    size_t current_queue() const;
+    void push(size_t queue, const Task &task);
+    // Takes a task, from the back of `queue` or else from the front of another one.
+    bool pop(size_t queue, Task &task);
+    void run(size_t queue, Task task);
+};
+
+#endif //UNTITLED_THREAD_POOL_H
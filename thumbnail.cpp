@@ -0,0 +1,190 @@
+#include "thumbnail.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "utils.h"
+
+namespace {
+
+// Reads the integers of an EXIF block, in its byte order.
+class TIFFReader {
+public:
+    explicit TIFFReader(std::span<const unsigned char> data): data(data) {}
+
+    // Checks the TIFF header, and reads the byte order from it.
+    bool valid_header() {
+        if (data.size() < 8) {
+            return false;
+        }
+        if (data[0] == 'I' && data[1] == 'I') {
+            big_endian = false;
+        } else if (data[0] == 'M' && data[1] == 'M') {
+            big_endian = true;
+        } else {
+            return false;
+        }
+        return u16(2) == 42;
+    }
+    bool contains(size_t offset, size_t length) const {
+        return offset <= data.size() && length <= data.size() - offset;
+    }
+    // Only at offsets where contains(offset, 2) or contains(offset, 4).
+    unsigned int u16(size_t offset) const {
+        return big_endian ? u8_to_u16(data[offset], data[offset + 1]) : u8_to_u16(data[offset + 1], data[offset]);
+    }
+    unsigned int u32(size_t offset) const {
+        unsigned int high = u16(offset + (big_endian ? 0 : 2));
+        unsigned int low = u16(offset + (big_endian ? 2 : 0));
+        return (high << 16) | low;
+    }
+    std::span<const unsigned char> bytes(size_t offset, size_t length) const {
+        return data.subspan(offset, length);
+    }
+
+private:
+    std::span<const unsigned char> data;
+    bool big_endian = false;
+};
+
+// The JPEG thumbnail of an EXIF block (the content of an APP1 segment after its identifier), which is given by
+// the JPEGInterchangeFormat (offset) and JPEGInterchangeFormatLength tags of its second IFD.
+std::optional<Thumbnail> exif_thumbnail(std::span<const unsigned char> exif) {
+    TIFFReader tiff {exif};
+    if (!tiff.valid_header() || !tiff.contains(4, 4)) {
+        return std::nullopt;
+    }
+    // Goes over the entries of the first IFD (the main image's) to the offset of the next one.
+    size_t ifd = tiff.u32(4);
+    if (!tiff.contains(ifd, 2) || !tiff.contains(ifd + 2, 12 * tiff.u16(ifd) + 4)) {
+        return std::nullopt;
+    }
+    ifd = tiff.u32(ifd + 2 + 12 * tiff.u16(ifd));
+    if (ifd == 0 || !tiff.contains(ifd, 2) || !tiff.contains(ifd + 2, 12 * tiff.u16(ifd))) {
+        return std::nullopt;
+    }
+
+    size_t offset = 0;
+    size_t length = 0;
+    for (unsigned int i = 0; i < tiff.u16(ifd); i++) {
+        size_t entry = ifd + 2 + 12 * i;
+        unsigned int tag = tiff.u16(entry);
+        unsigned int type = tiff.u16(entry + 2);
+        // A LONG, or a SHORT stored in the first half of the value field.
+        unsigned int value = type == 3 ? tiff.u16(entry + 8) : tiff.u32(entry + 8);
+        if (tag == 0x0201) {
+            offset = value;
+        } else if (tag == 0x0202) {
+            length = value;
+        }
+    }
+    if (length < 2 || !tiff.contains(offset, length)) {
+        return std::nullopt;
+    }
+    std::span<const unsigned char> thumbnail = tiff.bytes(offset, length);
+    if (thumbnail[0] != 0xff || thumbnail[1] != 0xd8) {
+        return std::nullopt;
+    }
+    return Thumbnail {ThumbnailFormat::JPEG, 0, 0, thumbnail};
+}
+
+// RGB pixels preceded by their dimensions, as in JFIF and JFXX segments.
+std::optional<Thumbnail> rgb_thumbnail(std::span<const unsigned char> content) {
+    if (content.size() < 2 || content[0] == 0 || content[1] == 0) {
+        return std::nullopt;
+    }
+    size_t size = (size_t) content[0] * content[1] * 3;
+    if (content.size() - 2 < size) {
+        return std::nullopt;
+    }
+    return Thumbnail {ThumbnailFormat::RGB, content[0], content[1], content.subspan(2, size)};
+}
+
+std::optional<Thumbnail> app_thumbnail(unsigned char marker, std::span<const unsigned char> content) {
+    if (marker == 0xe0 && content.size() >= 14 && std::memcmp(content.data(), "JFIF\0", 5) == 0) {
+        // After the version, density unit and densities.
+        return rgb_thumbnail(content.subspan(12));
+    }
+    if (marker == 0xe0 && content.size() >= 6 && std::memcmp(content.data(), "JFXX\0", 5) == 0) {
+        // The extension code gives the format (the palette one is not supported).
+        if (content[5] == 0x10 && content.size() >= 8) {
+            return Thumbnail {ThumbnailFormat::JPEG, 0, 0, content.subspan(6)};
+        }
+        if (content[5] == 0x13) {
+            return rgb_thumbnail(content.subspan(6));
+        }
+        return std::nullopt;
+    }
+    if (marker == 0xe1 && content.size() >= 6 && std::memcmp(content.data(), "Exif\0\0", 6) == 0) {
+        return exif_thumbnail(content.subspan(6));
+    }
+    return std::nullopt;
+}
+
+}
+
+std::optional<Thumbnail> find_thumbnail(std::span<const unsigned char> data) {
+    if (data.size() < 2 || data[0] != 0xff || data[1] != 0xd8) {
+        throw std::runtime_error("Not a JPEG file");
+    }
+
+    size_t index = 2;
+    while (index + 4 <= data.size()) {
+        if (data[index] != 0xff) {
+            return std::nullopt;
+        }
+        unsigned char marker = data[index + 1];
+        if (marker == 0xff) {
+            index += 1;
+            continue;
+        }
+        if ((marker >= 0xd0 && marker <= 0xd7) || marker == 0x01) {
+            index += 2;
+            continue;
+        }
+        // Thumbnails are in the headers, there is no point in going through the entropy-coded data.
+        if (marker == 0xd9 || marker == 0xda) {
+            break;
+        }
+
+        unsigned short length = u8_to_u16(data[index + 2], data[index + 3]);
+        size_t segment_end = index + 2 + length;
+        if (length < 2 || segment_end > data.size()) {
+            break;
+        }
+        if (marker == 0xe0 || marker == 0xe1) {
+            std::optional<Thumbnail> thumbnail = app_thumbnail(marker, data.subspan(index + 4, length - 2));
+            if (thumbnail) {
+                return thumbnail;
+            }
+        }
+        index = segment_end;
+    }
+    return std::nullopt;
+}
+
+Image decode_thumbnail(const Thumbnail &thumbnail, PixelFormat format) {
+    if (thumbnail.format == ThumbnailFormat::JPEG) {
+        JPEGParser parser {thumbnail.data};
+        return decode_image(parser.parse(), format);
+    }
+
+    Image image {thumbnail.width, thumbnail.height, format, {}};
+    int bpp = bytes_per_pixel(format);
+    image.pixels.resize((size_t) image.width * image.height * bpp);
+    for (size_t i = 0; i < (size_t) image.width * image.height; i++) {
+        const unsigned char *rgb = thumbnail.data.data() + 3 * i;
+        unsigned char *pixel = image.pixels.data() + bpp * i;
+        if (format == PixelFormat::BGR) {
+            pixel[0] = rgb[2];
+            pixel[1] = rgb[1];
+            pixel[2] = rgb[0];
+        } else {
+            std::memcpy(pixel, rgb, 3);
+        }
+        if (format == PixelFormat::RGBA) {
+            pixel[3] = 255;
+        }
+    }
+    return image;
+}
@@ -0,0 +1,33 @@
+#ifndef UNTITLED_THUMBNAIL_H
+#define UNTITLED_THUMBNAIL_H
+
+#include <optional>
+#include <span>
+
+#include "decoder.h"
+
+enum class ThumbnailFormat {
+    // Rows of 3-byte RGB pixels, without padding: JFIF thumbnails, and JFXX ones stored as RGB.
+    RGB,
+    // A whole JPEG file: EXIF thumbnails, and JFXX ones stored as JPEG.
+    JPEG,
+};
+
+struct Thumbnail {
+    ThumbnailFormat format;
+    // Only known without decoding for RGB thumbnails, 0 for JPEG ones (see probe()).
+    int width;
+    int height;
+    // Into the data passed to find_thumbnail(), nothing is copied.
+    std::span<const unsigned char> data;
+};
+
+// Looks for an embedded thumbnail in the APP0 (JFIF and JFXX) and APP1 (EXIF) segments, going through the
+// segments before the first scan by their lengths only. The first thumbnail found is returned, or nothing if
+// there is none (or it is malformed). Throws std::runtime_error if the data is not a JPEG file.
+std::optional<Thumbnail> find_thumbnail(std::span<const unsigned char> data);
+
+// Decodes a thumbnail, without touching the image it is embedded in.
+Image decode_thumbnail(const Thumbnail &thumbnail, PixelFormat format = PixelFormat::RGB);
+
+#endif //UNTITLED_THUMBNAIL_H
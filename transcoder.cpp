@@ -0,0 +1,488 @@
+#include "transcoder.h"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+#include "color.h"
+#include "huffman.h"
+#include "utils.h"
+
+namespace {
+
+// A transform as a transposition followed by flips of the axes of the transposed image.
+struct Axes {
+    bool transpose;
+    bool flip_x;
+    bool flip_y;
+};
+
+Axes transform_axes(Transform transform) {
+    switch (transform) {
+        case Transform::None:
+            return Axes {false, false, false};
+        case Transform::FlipHorizontal:
+            return Axes {false, true, false};
+        case Transform::FlipVertical:
+            return Axes {false, false, true};
+        case Transform::Transpose:
+            return Axes {true, false, false};
+        case Transform::Transverse:
+            return Axes {true, true, true};
+        case Transform::Rotate90:
+            return Axes {true, true, false};
+        case Transform::Rotate180:
+            return Axes {false, true, true};
+        case Transform::Rotate270:
+            return Axes {true, false, true};
+    }
+    return Axes {false, false, false};
+}
+
+QuantizationTable transpose_table(const QuantizationTable &table) {
+    std::array<unsigned short, 64> natural {};
+    for (int k = 0; k < 64; k++) {
+        natural[ZIGZAG[k]] = table.data[k];
+    }
+    std::array<unsigned short, 64> data {};
+    for (int k = 0; k < 64; k++) {
+        int row = ZIGZAG[k] / 8;
+        int column = ZIGZAG[k] % 8;
+        data[k] = natural[column * 8 + row];
+    }
+    return QuantizationTable::from_data(data);
+}
+
+void transform_block(const short *source, short *destination, Axes axes) {
+    for (int v = 0; v < 8; v++) {
+        for (int u = 0; u < 8; u++) {
+            short value = axes.transpose ? source[u * 8 + v] : source[v * 8 + u];
+            // Mirroring a cosine of odd frequency changes its sign, even ones are symmetric.
+            if ((axes.flip_x && (u & 1)) != (axes.flip_y && (v & 1))) {
+                value = (short) -value;
+            }
+            destination[v * 8 + u] = value;
+        }
+    }
+}
+
+// Huffman tables of a component, as indexes in ScanSymbols::frequencies: DC and AC tables 0 for the first
+// component, tables 1 for the others.
+int dc_table(int component) {
+    return component == 0 ? 0 : 1;
+}
+
+int ac_table(int component) {
+    return component == 0 ? 2 : 3;
+}
+
+// Symbols of the scan, gathered in a first pass over the coefficients so that the Huffman tables can be built
+// from their frequencies before anything is written.
+struct ScanSymbols {
+    // For the DC tables 0 and 1, then the AC tables 0 and 1.
+    std::array<std::array<unsigned long long, 256>, 4> frequencies {};
+    // In the order of the scan, with the index of the table in bits 8 and 9 and the magnitude bits following
+    // the code (as many as the low 4 bits of the symbol) from bit 16.
+    std::vector<unsigned int> symbols;
+
+    void add(int table, unsigned char symbol, unsigned int magnitude) {
+        frequencies[table][symbol] += 1;
+        symbols.push_back((magnitude << 16) | (table << 8) | symbol);
+    }
+};
+
+// Category of a value (F.1.2.1), and the magnitude bits coding it within its category: negative values are
+// coded as their one's complement.
+std::pair<int, unsigned int> magnitude(int value) {
+    int size = std::bit_width((unsigned int) (value < 0 ? -value : value));
+    return {size, (unsigned int) (value < 0 ? value - 1 : value) & ((1u << size) - 1)};
+}
+
+void add_block(const short *block, int component, int &dc_prediction, ScanSymbols &symbols) {
+    auto [size, bits] = magnitude(block[0] - dc_prediction);
+    dc_prediction = block[0];
+    if (size > 11) {
+        throw std::runtime_error("Coefficient out of range");
+    }
+    symbols.add(dc_table(component), (unsigned char) size, bits);
+
+    // The AC coefficients are mostly zeros, only the others are gone through, in zig-zag order.
+    std::array<short, 64> coefficients;
+    unsigned long long nonzero = 0;
+    for (int k = 1; k < 64; k++) {
+        coefficients[k] = block[ZIGZAG[k]];
+        nonzero |= (unsigned long long) (coefficients[k] != 0) << k;
+    }
+    int table = ac_table(component);
+    int previous = 0;
+    while (nonzero != 0) {
+        int k = std::countr_zero(nonzero);
+        nonzero &= nonzero - 1;
+        int run = k - previous - 1;
+        for (; run > 15; run -= 16) {
+            symbols.add(table, 0xf0, 0);
+        }
+        std::tie(size, bits) = magnitude(coefficients[k]);
+        if (size > 10) {
+            throw std::runtime_error("Coefficient out of range");
+        }
+        symbols.add(table, (unsigned char) ((run << 4) | size), bits);
+        previous = k;
+    }
+    if (previous != 63) {
+        symbols.add(table, 0x00, 0);
+    }
+}
+
+// Goes through the blocks in the order of a scan of all the components (A.2).
+ScanSymbols scan_symbols(const JPEGEncoded &encoded) {
+    const FrameHeader &frame = encoded.frame;
+    ScanSymbols symbols;
+    // A rough guess, real images have a few coded coefficients per block.
+    size_t blocks = 0;
+    for (const ComponentCoefficients &coefficients: encoded.coefficients) {
+        blocks += (size_t) coefficients.blocks_x * coefficients.blocks_y;
+    }
+    symbols.symbols.reserve(blocks * 8);
+
+    std::array<int, 4> dc_predictions {};
+    if (frame.components_nbr == 1) {
+        // Not interleaved: the blocks covering the component, without the padding to whole MCUs.
+        const FrameComponent &component = frame.components[0];
+        int width = (frame.width * component.h + frame.h_max - 1) / frame.h_max;
+        int height = (frame.height * component.v + frame.v_max - 1) / frame.v_max;
+        for (int by = 0; by < (height + 7) / 8; by++) {
+            for (int bx = 0; bx < (width + 7) / 8; bx++) {
+                add_block(encoded.coefficients[0].block(bx, by), 0, dc_predictions[0], symbols);
+            }
+        }
+        return symbols;
+    }
+    for (int mcu_y = 0; mcu_y < frame.mcus_y(); mcu_y++) {
+        for (int mcu_x = 0; mcu_x < frame.mcus_x(); mcu_x++) {
+            for (int c = 0; c < frame.components_nbr; c++) {
+                const FrameComponent &component = frame.components[c];
+                for (int v = 0; v < component.v; v++) {
+                    for (int h = 0; h < component.h; h++) {
+                        const short *block = encoded.coefficients[c].block(mcu_x * component.h + h,
+                                                                           mcu_y * component.v + v);
+                        add_block(block, c, dc_predictions[c], symbols);
+                    }
+                }
+            }
+        }
+    }
+    return symbols;
+}
+
+// Writes the entropy-coded data of the symbols, appended to `output`.
+class ScanWriter {
+public:
+    ScanWriter(std::vector<unsigned char> &output, const std::array<HuffmanTable, 4> &tables):
+    output(output), start(output.size()) {
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < tables[i].codes_nbr; j++) {
+                const HuffmanCode &code = tables[i].codes[j];
+                codes[i][code.value] = code.code;
+                lengths[i][code.value] = code.length;
+            }
+        }
+    }
+
+    void write(std::span<const unsigned int> symbols) {
+        for (unsigned int symbol: symbols) {
+            int table = (symbol >> 8) & 3;
+            int value = symbol & 0xff;
+            int size = value & 0x0f;
+            put((codes[table][value] << size) | (symbol >> 16), lengths[table][value] + size);
+        }
+    }
+
+    // Pads the last byte with ones, and gives the unused end of the output back.
+    void finish() {
+        int padding = (8 - buffered % 8) % 8;
+        buffer = (buffer << padding) | ((1u << padding) - 1);
+        buffered += padding;
+        while (buffered > 0) {
+            buffered -= 8;
+            put_byte((unsigned char) (buffer >> buffered));
+        }
+        output.resize(start + written);
+    }
+
+private:
+    std::vector<unsigned char> &output;
+    size_t start;
+    size_t written = 0;
+    // Indexed by table (as in ScanSymbols) and value.
+    std::array<std::array<unsigned int, 256>, 4> codes {};
+    std::array<std::array<unsigned char, 256>, 4> lengths {};
+    // Only the last `buffered` bits of `buffer` are left to write, fewer than 32 between two calls.
+    unsigned long long buffer = 0;
+    int buffered = 0;
+
+    // At most 27 bits: a 16-bit code and 11 magnitude bits.
+    void put(unsigned int bits, int length) {
+        buffer = (buffer << length) | bits;
+        buffered += length;
+        if (buffered < 32) {
+            return;
+        }
+        buffered -= 32;
+        auto word = (unsigned int) (buffer >> buffered);
+        // At least 8 bytes of room, for 4 bytes all followed by a stuffed 0.
+        if (output.size() - start - written < 8) {
+            output.resize(std::max<size_t>(output.size() * 2, output.size() + 4096));
+        }
+        // Written at once unless one of the bytes is 0xff, which has to be followed by a stuffed 0 so that the
+        // data cannot be taken for a marker.
+        unsigned int inverted = ~word;
+        if (((inverted - 0x01010101u) & ~inverted & 0x80808080u) == 0) {
+            unsigned char *next = output.data() + start + written;
+            next[0] = (unsigned char) (word >> 24);
+            next[1] = (unsigned char) (word >> 16);
+            next[2] = (unsigned char) (word >> 8);
+            next[3] = (unsigned char) word;
+            written += 4;
+        } else {
+            for (int shift = 24; shift >= 0; shift -= 8) {
+                put_byte((unsigned char) (word >> shift));
+            }
+        }
+    }
+
+    void put_byte(unsigned char byte) {
+        if (output.size() - start - written < 2) {
+            output.resize(output.size() + 4096);
+        }
+        output[start + written++] = byte;
+        if (byte == 0xff) {
+            output[start + written++] = 0;
+        }
+    }
+};
+
+void put_u16(std::vector<unsigned char> &output, unsigned int value) {
+    output.push_back((unsigned char) (value >> 8));
+    output.push_back((unsigned char) value);
+}
+
+// Writes the marker and length of a segment of `length` bytes, length field included.
+void put_segment_header(std::vector<unsigned char> &output, unsigned char marker, unsigned int length) {
+    output.push_back(0xff);
+    output.push_back(marker);
+    put_u16(output, length);
+}
+
+void put_huffman_table(std::vector<unsigned char> &output, unsigned char table_class, unsigned char identifier,
+                       const HuffmanTable &table) {
+    std::array<unsigned char, 16> size_data {};
+    for (int i = 0; i < table.codes_nbr; i++) {
+        size_data[table.codes[i].length - 1] += 1;
+    }
+    put_segment_header(output, 0xc4, 2 + 1 + 16 + table.codes_nbr);
+    output.push_back((unsigned char) ((table_class << 4) | identifier));
+    output.insert(output.end(), size_data.begin(), size_data.end());
+    for (int i = 0; i < table.codes_nbr; i++) {
+        output.push_back(table.codes[i].value);
+    }
+}
+
+}
+
+void transform_coefficients(JPEGEncoded &encoded, Transform transform, const CropRegion &crop) {
+    Axes axes = transform_axes(transform);
+    bool cropped = crop.x != 0 || crop.y != 0 || crop.width != 0 || crop.height != 0;
+    if ((transform == Transform::None && !cropped) || encoded.frame.components_nbr == 0) {
+        return;
+    }
+
+    FrameHeader frame = encoded.frame;
+    if (axes.transpose) {
+        std::swap(frame.width, frame.height);
+        std::swap(frame.h_max, frame.v_max);
+        for (int c = 0; c < frame.components_nbr; c++) {
+            std::swap(frame.components[c].h, frame.components[c].v);
+        }
+        for (int i = 0; i < encoded.q_tables_nbr; i++) {
+            encoded.q_tables[i] = transpose_table(encoded.q_tables[i]);
+        }
+    }
+    if (axes.flip_x) {
+        frame.width -= frame.width % (8 * frame.h_max);
+    }
+    if (axes.flip_y) {
+        frame.height -= frame.height % (8 * frame.v_max);
+    }
+    if (frame.width == 0 || frame.height == 0) {
+        throw std::runtime_error("Image smaller than an MCU");
+    }
+
+    // MCUs of the transformed image, and the first one of the crop region.
+    int mcus_x = frame.mcus_x();
+    int mcus_y = frame.mcus_y();
+    int first_mcu_x = 0;
+    int first_mcu_y = 0;
+    if (cropped) {
+        if (crop.x < 0 || crop.y < 0 || crop.width < 0 || crop.height < 0 || crop.x >= frame.width ||
+            crop.y >= frame.height) {
+            throw std::runtime_error("Crop region outside of the image");
+        }
+        first_mcu_x = crop.x / (8 * frame.h_max);
+        first_mcu_y = crop.y / (8 * frame.v_max);
+        int x = first_mcu_x * 8 * frame.h_max;
+        int y = first_mcu_y * 8 * frame.v_max;
+        int width = crop.width == 0 ? frame.width - crop.x : std::min(crop.width, frame.width - crop.x);
+        int height = crop.height == 0 ? frame.height - crop.y : std::min(crop.height, frame.height - crop.y);
+        frame.width = (unsigned short) (width + crop.x - x);
+        frame.height = (unsigned short) (height + crop.y - y);
+    }
+
+    // With whole MCUs along the flipped directions, the last block of the transformed grid maps to the first one.
+    // The crop region starts on an MCU, and its partial MCUs are completed by the blocks following it.
+    std::vector<ComponentCoefficients> coefficients(frame.components_nbr);
+    for (int c = 0; c < frame.components_nbr; c++) {
+        const FrameComponent &component = frame.components[c];
+        const ComponentCoefficients &source = encoded.coefficients[c];
+        ComponentCoefficients &destination = coefficients[c];
+        destination = ComponentCoefficients::allocate(frame.mcus_x() * component.h, frame.mcus_y() * component.v,
+                                                      encoded.arena);
+        for (int by = 0; by < destination.blocks_y; by++) {
+            int y = first_mcu_y * component.v + by;
+            if (axes.flip_y) {
+                y = mcus_y * component.v - 1 - y;
+            }
+            for (int bx = 0; bx < destination.blocks_x; bx++) {
+                int x = first_mcu_x * component.h + bx;
+                if (axes.flip_x) {
+                    x = mcus_x * component.h - 1 - x;
+                }
+                const short *block = axes.transpose ? source.block(y, x) : source.block(x, y);
+                transform_block(block, destination.block(bx, by), axes);
+            }
+        }
+    }
+    encoded.frame = frame;
+    encoded.coefficients = std::move(coefficients);
+}
+
+std::vector<unsigned char> encode_coefficients(const JPEGEncoded &encoded,
+                                               std::span<const std::span<const unsigned char>> segments) {
+    const FrameHeader &frame = encoded.frame;
+    if (frame.components_nbr == 0 || encoded.coefficients.size() != frame.components_nbr) {
+        throw std::runtime_error("No frame to encode");
+    }
+
+    // The symbols are gathered first, to build the tables they are then coded with.
+    ScanSymbols symbols = scan_symbols(encoded);
+    int tables_nbr = frame.components_nbr == 1 ? 1 : 2;
+    std::array<HuffmanTable, 4> tables {};
+    for (int i = 0; i < tables_nbr; i++) {
+        tables[dc_table(i)] = HuffmanTable::from_frequencies(symbols.frequencies[dc_table(i)]);
+        tables[ac_table(i)] = HuffmanTable::from_frequencies(symbols.frequencies[ac_table(i)]);
+    }
+
+    std::vector<unsigned char> output;
+    output.push_back(0xff);
+    output.push_back(0xd8);
+
+    // An APP14 segment makes decoders take the components as Adobe ones rather than JFIF ones.
+    bool has_app = std::any_of(segments.begin(), segments.end(), [](std::span<const unsigned char> segment) {
+        return segment.size() >= 2 && (segment[1] == 0xe0 || segment[1] == 0xee);
+    });
+    bool jfif_colors = frame.components_nbr == 1 ||
+                       (frame.components_nbr == 3 && color_space(frame) == ColorSpace::YCbCr);
+    if (!has_app && jfif_colors) {
+        const JFIFData &metadata = encoded.metadata;
+        // Files without JFIF segment have no density, which is then only an aspect ratio of 1.
+        bool has_density = metadata.x_density != 0 && metadata.y_density != 0;
+        put_segment_header(output, 0xe0, 16);
+        output.insert(output.end(), {'J', 'F', 'I', 'F', 0, 1, 2});
+        output.push_back(has_density ? (unsigned char) metadata.density_unit : 0);
+        put_u16(output, has_density ? metadata.x_density : 1);
+        put_u16(output, has_density ? metadata.y_density : 1);
+        output.push_back(0);
+        output.push_back(0);
+    }
+    for (std::span<const unsigned char> segment: segments) {
+        output.insert(output.end(), segment.begin(), segment.end());
+    }
+
+    // Extended sequential (SOF1) is only needed for 16-bit quantization values.
+    bool wide_tables = false;
+    for (int c = 0; c < frame.components_nbr; c++) {
+        const QuantizationTable &table = encoded.q_tables[frame.components[c].q_table_id];
+        wide_tables |= std::any_of(table.data.begin(), table.data.end(), [](unsigned short q) { return q > 255; });
+    }
+    for (int i = 0; i < encoded.q_tables_nbr; i++) {
+        bool used = std::any_of(frame.components.begin(), frame.components.begin() + frame.components_nbr,
+                                [i](const FrameComponent &component) { return component.q_table_id == i; });
+        if (!used) {
+            continue;
+        }
+        const QuantizationTable &table = encoded.q_tables[i];
+        bool wide = std::any_of(table.data.begin(), table.data.end(), [](unsigned short q) { return q > 255; });
+        put_segment_header(output, 0xdb, 2 + 1 + (wide ? 128 : 64));
+        output.push_back((unsigned char) ((wide ? 0x10 : 0) | i));
+        for (unsigned short q: table.data) {
+            if (wide) {
+                put_u16(output, q);
+            } else {
+                output.push_back((unsigned char) q);
+            }
+        }
+    }
+
+    put_segment_header(output, wide_tables ? 0xc1 : 0xc0, 8 + 3 * frame.components_nbr);
+    output.push_back(frame.precision);
+    put_u16(output, frame.height);
+    put_u16(output, frame.width);
+    output.push_back(frame.components_nbr);
+    for (int c = 0; c < frame.components_nbr; c++) {
+        const FrameComponent &component = frame.components[c];
+        output.push_back(component.id);
+        output.push_back((unsigned char) ((component.h << 4) | component.v));
+        output.push_back(component.q_table_id);
+    }
+
+    for (int i = 0; i < tables_nbr; i++) {
+        put_huffman_table(output, 0, (unsigned char) i, tables[dc_table(i)]);
+        put_huffman_table(output, 1, (unsigned char) i, tables[ac_table(i)]);
+    }
+
+    put_segment_header(output, 0xda, 6 + 2 * frame.components_nbr);
+    output.push_back(frame.components_nbr);
+    for (int c = 0; c < frame.components_nbr; c++) {
+        output.push_back(frame.components[c].id);
+        // The DC and AC tables of a component have the same identifier.
+        output.push_back((unsigned char) ((dc_table(c) << 4) | dc_table(c)));
+    }
+    output.insert(output.end(), {0, 63, 0});
+
+    ScanWriter writer {output, tables};
+    writer.write(symbols.symbols);
+    writer.finish();
+
+    output.push_back(0xff);
+    output.push_back(0xd9);
+    return output;
+}
+
+std::vector<unsigned char> transcode(std::span<const unsigned char> data, const TranscodeOptions &options) {
+    JPEGParser parser {data};
+    std::vector<std::span<const unsigned char>> segments;
+    bool keep_metadata = options.keep_metadata;
+    parser.set_diagnostics([&segments, data, keep_metadata](const Diagnostic &diagnostic) {
+        // Adobe segments are always kept, as without them RGB and CMYK files would be taken for YCbCr ones.
+        bool metadata = (diagnostic.marker >= 0xe0 && diagnostic.marker <= 0xef) || diagnostic.marker == 0xfe;
+        if (diagnostic.marker == 0xee || (keep_metadata && metadata)) {
+            segments.push_back(data.subspan(diagnostic.offset, diagnostic.length + 2));
+        }
+    });
+    JPEGEncoded encoded {};
+    parser.parse(encoded);
+    transform_coefficients(encoded, options.transform, options.crop);
+    return encode_coefficients(encoded, segments);
+}
@@ -0,0 +1,52 @@
+#ifndef UNTITLED_TRANSCODER_H
+#define UNTITLED_TRANSCODER_H
+
+#include <span>
+#include <vector>
+
+#include "jpeg_parser.h"
+
+// Lossless transformations, done on the DCT coefficients. Rotations are clockwise.
+enum class Transform {None, FlipHorizontal, FlipVertical, Transpose, Transverse, Rotate90, Rotate180, Rotate270};
+
+// Region of the transformed image to keep, in pixels. As with jpegtran -crop, the top left corner is moved up
+// and left to a multiple of the MCU size, and the region grows by as much, so that the blocks are kept as they
+// are. A width or height of 0, or one going past the image, keeps everything right of or below the corner.
+struct CropRegion {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
+struct TranscodeOptions {
+    Transform transform = Transform::None;
+    // The whole image by default.
+    CropRegion crop;
+    // Keeps the APPn and COM segments of the source, e.g. its EXIF data (which is not updated for the transform).
+    // Otherwise only the Adobe APP14 segments are kept, as they tell the color space of the components, and
+    // a JFIF APP0 segment without thumbnail is written for YCbCr and grayscale images without one.
+    bool keep_metadata = false;
+};
+
+// Applies `transform` to the coefficients of a parsed image, taking the new ones from its arena. Block rows and
+// columns are mirrored and transposed, and within each block the coefficients are transposed (along with the
+// quantization tables) and the odd frequencies of a flipped direction negated, so nothing is requantized.
+// The edge of the image moved to the top or left by a flip is trimmed to a whole number of MCUs, as a partial
+// MCU can only be at the bottom or right. The blocks of `crop` are then copied alone. Throws
+// std::runtime_error if nothing is left, or the corner of `crop` is outside of the transformed image.
+void transform_coefficients(JPEGEncoded &encoded, Transform transform, const CropRegion &crop = {});
+
+// Writes the coefficients of `encoded` as a sequential file with a single scan and no restart markers, with
+// Huffman tables optimized for them: one for the first component and one shared by the others, for each of
+// the DC and AC coefficients. `segments` (whole marker segments, marker included) are copied after SOI.
+// Without an APP0 nor an Adobe APP14 among them, a JFIF APP0 segment is written first, from the metadata of
+// `encoded`, if the image is grayscale or YCbCr (JFIF has no other color spaces).
+std::vector<unsigned char> encode_coefficients(const JPEGEncoded &encoded,
+                                               std::span<const std::span<const unsigned char>> segments = {});
+
+// Parses a file, progressive ones included, into coefficients, and re-encodes them after the transform, without
+// inverse transforming them: pixels are not computed and the image is not degraded.
+std::vector<unsigned char> transcode(std::span<const unsigned char> data, const TranscodeOptions &options = {});
+
+#endif //UNTITLED_TRANSCODER_H